@@ -1,14 +1,33 @@
+#include "handlers.h"
+#include "lz.h"
+#include "packing.h"
+#include "protocol.h"
+
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <iostream>
+#include <mutex>
 #include <numeric>
 #include <random>
+#include <stdexcept>
 #include <thread>
 #include <vector>
 
 #include <boost/array.hpp>
 #include <boost/asio.hpp>
+#include <boost/asio/generic/stream_protocol.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+
+#include <unistd.h>
 
 using boost::asio::ip::tcp;
+using boost::asio::generic::stream_protocol;
 using namespace std;
 
 enum ProblemType {
@@ -20,24 +39,111 @@ enum ProblemType {
     RLE,
 };
 
-std::random_device rd;
-std::default_random_engine e1(rd());
-std::bernoulli_distribution uniform_dist(0.5);
+// A batch read from the server, with the sequence number it was sent with
+// when the protocol was negotiated
+struct Batch
+{
+    unsigned seq;
+    unsigned problemType;
+    std::vector<unsigned> expectedValues;
+    Problems<unsigned> iProblems;
+    Problems<char> sProblems;
+};
 
-template <class T>
-using Problems = boost::array<std::vector<T>, 4>;
+// How the problems of a batch are sent, as negotiated
+struct Framing
+{
+    bool packed;
+    bool compressed;
+};
 
-template <class T>
-void getProblems(tcp::socket& socket, unsigned pType, Problems<T>& data, boost::array<unsigned, 4>& expectedValues)
+// Reads from memory as if from the socket: batches the server wrote in the
+// shared ring, or problems once decompressed
+class BufferReader
+{
+public:
+    BufferReader(const char* data, size_t size) : mData(data), mSize(size) {}
+
+    template <class MutableBufferSequence>
+    size_t read_some(const MutableBufferSequence& buffers, boost::system::error_code& error)
+    {
+        size_t read = boost::asio::buffer_copy(buffers, boost::asio::buffer(mData, mSize));
+        mData += read;
+        mSize -= read;
+        error = read || boost::asio::buffer_size(buffers) == 0
+            ? boost::system::error_code() : boost::asio::error::eof;
+        return read;
+    }
+
+    template <class MutableBufferSequence>
+    size_t read_some(const MutableBufferSequence& buffers)
+    {
+        boost::system::error_code error;
+        size_t read = read_some(buffers, error);
+        if (error)
+            throw boost::system::system_error(error);
+        return read;
+    }
+
+private:
+    const char* mData;
+    size_t mSize;
+};
+
+// Reads a payload packed as in packing.h
+template <class Stream>
+std::vector<unsigned> readPacked(Stream& socket, unsigned pType)
+{
+    boost::array<unsigned, 2> header;
+    std::vector<unsigned char> packed;
+    std::vector<unsigned> dataBuf;
+
+    boost::asio::read(socket, boost::asio::buffer(header, sizeof(unsigned)));
+    if (pType == MAZE && header[0] != 0)
+    {
+        // Width, then height, then the rows of bits
+        boost::asio::read(socket, boost::asio::buffer(&header[1], sizeof(unsigned)));
+        packed.resize(header[1] * packedRowBytes(header[0]));
+        boost::asio::read(socket, boost::asio::buffer(packed));
+        dataBuf.resize(static_cast<size_t>(header[0]) * header[1]);
+        unpackMaze(packed.data(), header[0], header[1], dataBuf.data());
+    }
+    else if (pType == PASSWORD || pType == RLE)
+    {
+        packed.resize(header[0]);
+        boost::asio::read(socket, boost::asio::buffer(packed));
+        dataBuf.resize(header[0]);
+        unpackString(packed.data(), packed.size(), dataBuf.data());
+    }
+    else
+    {
+        // Mazes that are not made of bits come as the other arrays
+        if (pType == MAZE)
+            boost::asio::read(socket, boost::asio::buffer(header, sizeof(unsigned)));
+        unsigned char elementBytes;
+        boost::asio::read(socket, boost::asio::buffer(&elementBytes, 1));
+        if (elementBytes != 1 && elementBytes != 2 && elementBytes != 4)
+            throw std::runtime_error("Bad packed element size");
+        packed.resize(header[0] * elementBytes);
+        boost::asio::read(socket, boost::asio::buffer(packed));
+        dataBuf.resize(header[0]);
+        unpackElements(packed.data(), header[0], elementBytes, dataBuf.data());
+    }
+    return dataBuf;
+}
+
+template <class T, class Stream>
+void getProblems(Stream& socket, unsigned pType, size_t width, Framing framing, Problems<T>& data, std::vector<unsigned>& expectedValues)
 {
     // Clean up
-    std::fill(expectedValues.begin(), expectedValues.end(), 0);
+    expectedValues.assign(width, 0);
+    data.resize(width);
     std::for_each(data.begin(), data.end(), [](std::vector<T>& vec) { vec.clear(); });
 
     unsigned problemSize;
     boost::array<unsigned, 1> buf;
 
-    for (size_t i = 0; i < 4; i++)
+    for (size_t i = 0; i < width; i++)
     {
         buf[0] = 0;
 
@@ -49,109 +155,328 @@ void getProblems(tcp::socket& socket, unsigned pType, Problems<T>& data, boost::
             buf[0] = 0;
         }
 
-        // Read a problem size
-        boost::asio::read(socket, boost::asio::buffer(buf, sizeof(unsigned)));
-        problemSize = buf.front();
-        std::vector<unsigned> dataBuf(problemSize);
+        std::vector<unsigned> dataBuf;
+        if (framing.compressed)
+        {
+            // Decompress each problem as soon as it is in. What it decodes to
+            // is sized in elements, or in bytes once packed.
+            boost::array<unsigned, 2> sizes;
+            boost::asio::read(socket, boost::asio::buffer(sizes));
+            std::vector<unsigned char> compressedBuf(sizes[1]);
+            boost::asio::read(socket, boost::asio::buffer(compressedBuf));
+            std::vector<unsigned char> decoded(framing.packed ? sizes[0] : sizes[0] * sizeof(unsigned));
+            if (!lzDecompress(compressedBuf.data(), compressedBuf.size(), decoded.data(), decoded.size()))
+                throw std::runtime_error("Corrupt compressed problem");
+
+            if (framing.packed)
+            {
+                BufferReader reader(reinterpret_cast<const char*>(decoded.data()), decoded.size());
+                dataBuf = readPacked(reader, pType);
+            }
+            else
+            {
+                dataBuf.resize(sizes[0]);
+                std::memcpy(dataBuf.data(), decoded.data(), decoded.size());
+            }
+        }
+        else if (framing.packed)
+        {
+            dataBuf = readPacked(socket, pType);
+        }
+        else
+        {
+            // Read a problem size
+            boost::asio::read(socket, boost::asio::buffer(buf, sizeof(unsigned)));
+            problemSize = buf.front();
+            dataBuf.resize(problemSize);
 
-        // Read a problem data
-        // NOTE: Everything is transmitted as an unsigned integer from the server side
-        boost::asio::read(socket, boost::asio::buffer(dataBuf, problemSize * sizeof(unsigned)));
+            // Read a problem data
+            // NOTE: Everything is transmitted as an unsigned integer from the server side
+            boost::asio::read(socket, boost::asio::buffer(dataBuf, problemSize * sizeof(unsigned)));
+        }
 
         std::copy(dataBuf.begin(), dataBuf.end(), std::back_inserter(data[i]));
     }
 }
 
-boost::array<bool, 4> handleMazeProblem(const Problems<unsigned>& mazes)
+template <class Stream>
+void readBatch(Stream& socket, unsigned problemType, size_t width, Batch& batch, Framing framing = Framing())
 {
-    boost::array<bool, 4> answer_buf;
-
-    // Generate random answer
-    for (int i = 0; i < 4; ++i)
-        answer_buf[i] = uniform_dist(e1);
-
-    return answer_buf;
+    batch.problemType = problemType;
+    if (problemType < PASSWORD)
+        getProblems<unsigned>(socket, problemType, width, framing, batch.iProblems, batch.expectedValues);
+    else
+        getProblems<char>(socket, problemType, width, framing, batch.sProblems, batch.expectedValues);
 }
 
-boost::array<bool, 4> handleSudokuProblem(const Problems<unsigned>& sudokus)
+Answers solve(const Batch& batch)
 {
-    boost::array<bool, 4> answer_buf;
-
-    // Generate random answer
-    for (int i = 0; i < 4; ++i)
-        answer_buf[i] = uniform_dist(e1);
-
+    Answers answer_buf;
+    switch (batch.problemType)
+    {
+    case MAZE:
+        answer_buf = handleMazeProblem(batch.iProblems);
+        break;
+    case SUDOKU:
+        answer_buf = handleSudokuProblem(batch.iProblems);
+        break;
+    case TREE:
+        answer_buf = handleTreeProblem(batch.iProblems);
+        break;
+    case ARRAY:
+        answer_buf = handleArrayProblem(batch.iProblems, batch.expectedValues);
+        break;
+    case PASSWORD:
+        answer_buf = handlePasswordProblem(batch.sProblems);
+        break;
+    case RLE:
+        answer_buf = handleRLEProblem(batch.sProblems, batch.expectedValues);
+        break;
+    }
     return answer_buf;
 }
 
-boost::array<bool, 4> handleTreeProblem(const Problems<unsigned>& trees)
+void thinkAboutIt()
 {
-    boost::array<bool, 4> answer_buf;
-
-    // Generate random answer
-    for (int i = 0; i < 4; ++i)
-        answer_buf[i] = uniform_dist(e1);
-
-    return answer_buf;
+    if (uniform_dist(e1))
+      this_thread::sleep_for(chrono::milliseconds(100));
+    else
+      this_thread::sleep_for(chrono::milliseconds(6000));
 }
 
-boost::array<bool, 4> handleArrayProblem(const Problems<unsigned>& arrays, const boost::array<unsigned, 4>& expectedValues)
+// Ask the server for the given options, after which options and version
+// hold what it agreed to. The server must know about the handshake, see
+// protocol.h: anything but an Ack is an error.
+void negotiate(stream_protocol::socket& socket, HandshakeOptions& options, uint32_t& version)
 {
-    boost::array<bool, 4> answer_buf;
-
-    // Generate random answer
-    for (int i = 0; i < 4; ++i)
-        answer_buf[i] = uniform_dist(e1);
-
-    return answer_buf;
+    boost::array<uint32_t, 3 + NB_OPTIONS> hello;
+    hello[0] = HELLO_MAGIC;
+    hello[1] = PROTOCOL_VERSION;
+    hello[2] = NB_OPTIONS;
+    std::copy(options.begin(), options.end(), hello.begin() + 3);
+    boost::asio::write(socket, boost::asio::buffer(hello));
+
+    // The server sent a batch before it saw the Hello, it is withdrawn
+    boost::array<unsigned, 1> buf;
+    Batch withdrawn;
+    boost::asio::read(socket, boost::asio::buffer(buf));
+    readBatch(socket, buf[0], 4, withdrawn);
+
+    boost::asio::read(socket, boost::asio::buffer(buf));
+    if (buf[0] != ACK_MAGIC)
+        throw std::runtime_error("The server did not acknowledge the handshake, run without a window");
+
+    boost::array<uint32_t, 2> ack;
+    boost::asio::read(socket, boost::asio::buffer(ack));
+    version = ack[0];
+    std::vector<uint32_t> accepted(ack[1]);
+    boost::asio::read(socket, boost::asio::buffer(accepted));
+    options = defaultHandshakeOptions();
+    std::copy_n(accepted.begin(), std::min<size_t>(accepted.size(), NB_OPTIONS), options.begin());
 }
 
-boost::array<bool, 4> handlePasswordProblem(const Problems<char>& passwords)
+// Read batches on this thread and solve them on one thread per batch in
+// flight. With a shared ring, the problems are read from it instead of the
+// socket, see protocol.h.
+void runPipelined(stream_protocol::socket& socket, unsigned window, unsigned width, uint32_t ringKey, Framing framing)
 {
-    boost::array<bool, 4> answer_buf;
-
-    // Generate random answer
-    for (int i = 0; i < 4; ++i)
-        answer_buf[i] = uniform_dist(e1);
+    // Answers go out on a socket object of their own, over a duplicate of
+    // the descriptor, as an asio socket may not be read on one thread while
+    // it is written on another. Writers still take turns.
+    int writeDescriptor = ::dup(socket.native_handle());
+    if (writeDescriptor < 0)
+        throw boost::system::system_error(errno, boost::system::system_category(), "dup");
+    stream_protocol::socket answers(socket.get_executor(), socket.local_endpoint().protocol(), writeDescriptor);
+
+    boost::interprocess::mapped_region ring;
+    if (ringKey)
+    {
+        boost::interprocess::shared_memory_object segment(
+            boost::interprocess::open_only, sharedRingName(ringKey).c_str(),
+            boost::interprocess::read_only);
+        ring = boost::interprocess::mapped_region(segment, boost::interprocess::read_only);
+    }
 
-    return answer_buf;
-}
+    std::mutex queueMutex;
+    std::mutex answersMutex;
+    std::condition_variable ready;
+    std::deque<Batch> queue;
+    bool done = false;
 
-boost::array<bool, 4> handleRLEProblem(const Problems<char>& rles, const boost::array<unsigned, 4>& expectedValues)
-{
-    boost::array<bool, 4> answer_buf;
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < window; ++i)
+    {
+        workers.emplace_back([&]() {
+            for (;;)
+            {
+                Batch batch;
+                {
+                    std::unique_lock<std::mutex> lock(queueMutex);
+                    ready.wait(lock, [&]() { return done || !queue.empty(); });
+                    if (queue.empty())
+                        return;
+                    batch = std::move(queue.front());
+                    queue.pop_front();
+                }
+
+                Answers answer_buf = solve(batch);
+                thinkAboutIt();
+
+                // Sequence number, then the answers as a bitmap
+                std::vector<uint32_t> message(1 + answerWords(width), 0);
+                message[0] = batch.seq;
+                for (size_t i = 0; i < answer_buf.size(); ++i)
+                    message[1 + i / 32] |= static_cast<uint32_t>(answer_buf[i]) << (i % 32);
+
+                std::lock_guard<std::mutex> lock(answersMutex);
+                std::cout << "Sending answers for batch " << batch.seq << std::endl;
+                boost::system::error_code error;
+                boost::asio::write(answers, boost::asio::buffer(message), error);
+            }
+        });
+    }
 
-    // Generate random answer
-    for (int i = 0; i < 4; ++i)
-        answer_buf[i] = uniform_dist(e1);
+    try
+    {
+        for (;;)
+        {
+            boost::system::error_code error;
+            boost::array<uint32_t, 4> header;
+
+            // Read the sequence number and the problem type, then where the
+            // problems are in the ring
+            boost::asio::read(socket, boost::asio::buffer(header.data(), (ringKey ? 4 : 2) * sizeof(uint32_t)), error);
+            if (error == boost::asio::error::eof)
+                break; // Connection closed cleanly by peer.
+            else if (error)
+                throw boost::system::system_error(error); // Some other error.
+
+            Batch batch;
+            batch.seq = header[0];
+            if (ringKey && header[2] != NO_RING_OFFSET)
+            {
+                // The problems are copied out of the ring rather than solved
+                // in place, as the handlers take them in vectors. The batch
+                // may expire while it is copied and its space be written
+                // over, in which case its tag changes (see protocol.h) and
+                // it is dropped.
+                const char* problems = static_cast<const char*>(ring.get_address()) + header[2];
+                const std::atomic<uint32_t>& tag =
+                    *reinterpret_cast<const std::atomic<uint32_t>*>(problems - sizeof(uint32_t));
+                bool intact = tag.load(std::memory_order_acquire) == batch.seq;
+                bool parsed = false;
+                if (intact)
+                {
+                    try
+                    {
+                        BufferReader reader(problems, header[3]);
+                        readBatch(reader, header[1], width, batch, framing);
+                        parsed = true;
+                    }
+                    catch (const std::exception&)
+                    {
+                        // Problems written over halfway may not even parse
+                    }
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    intact = tag.load(std::memory_order_relaxed) == batch.seq;
+                }
+                if (!intact)
+                {
+                    std::cout << "Batch " << batch.seq << " expired while it was read, dropped" << std::endl;
+                    continue;
+                }
+                if (!parsed)
+                    throw std::runtime_error("Corrupt batch in the shared ring");
+            }
+            else
+            {
+                readBatch(socket, header[1], width, batch, framing);
+            }
+
+            std::lock_guard<std::mutex> lock(queueMutex);
+            queue.push_back(std::move(batch));
+            ready.notify_one();
+        }
+    }
+    catch (...)
+    {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            done = true;
+        }
+        ready.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+        throw;
+    }
 
-    return answer_buf;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        done = true;
+    }
+    ready.notify_all();
+    for (auto& worker : workers)
+        worker.join();
 }
 
 int main(int argc, char *argv[]) {
   try {
-    if (argc != 2) {
-      std::cerr << "Usage: client <host>" << std::endl;
+    if (argc < 2 || argc > 4) {
+      std::cerr << "Usage: client <host | Unix socket path> [window [width]]" << std::endl;
       return 1;
     }
 
     boost::asio::io_service io_service;
+    stream_protocol::socket socket(io_service);
+
+    // A path is the Unix domain socket of a server on this machine,
+    // anything else a host to reach over TCP
+    bool local = std::strchr(argv[1], '/') != nullptr;
+    if (local) {
+      socket.connect(boost::asio::local::stream_protocol::endpoint(argv[1]));
+    } else {
+      tcp::resolver resolver(io_service);
+      tcp::resolver::query query(argv[1], "22022");
+      boost::system::error_code error = boost::asio::error::host_not_found;
+      for (tcp::resolver::iterator it = resolver.resolve(query), end; error && it != end; ++it) {
+        socket.close();
+        socket.connect(it->endpoint(), error);
+      }
+      if (error)
+        throw boost::system::system_error(error);
+    }
 
-    tcp::resolver resolver(io_service);
-    tcp::resolver::query query(argv[1], "22022");
-    tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
-    tcp::socket socket(io_service);
-
-    // Connect Boost TCP Socket
-    boost::asio::connect(socket, endpoint_iterator);
-
-    //boost::asio::async_read();
+    // With a window, ask for batches to be pipelined, which only a server
+    // that knows about the handshake can be asked (see protocol.h). Batches are
+    // as wide as asked, or hold a problem per core, and the server may
+    // grant less of either. On the same machine, batches come through a
+    // shared ring when the server has one to give, from further away they
+    // come compressed when the server compresses them.
+    if (argc >= 3) {
+      HandshakeOptions options = defaultHandshakeOptions();
+      options[OPT_WINDOW] = std::strtoul(argv[2], nullptr, 10);
+      options[OPT_BATCH_WIDTH] = argc == 4
+          ? std::strtoul(argv[3], nullptr, 10)
+          : std::max(4u, std::thread::hardware_concurrency());
+      options[OPT_SHARED_RING] = local;
+      options[OPT_COMPRESSION] = !local;
+      uint32_t version;
+      negotiate(socket, options, version);
+      Framing framing;
+      framing.packed = version >= PACKED_PROTOCOL_VERSION;
+      framing.compressed = options[OPT_COMPRESSION] != 0;
+      std::cout << options[OPT_WINDOW] << " batches of "
+                << options[OPT_BATCH_WIDTH] << " problems in flight"
+                << (options[OPT_SHARED_RING] ? " through a shared ring" : "")
+                << (framing.packed ? ", packed" : "")
+                << (framing.compressed ? ", compressed" : "") << std::endl;
+      runPipelined(socket, options[OPT_WINDOW], options[OPT_BATCH_WIDTH], options[OPT_SHARED_RING],
+                   framing);
+      return 0;
+    }
 
     for (;;) {
-      unsigned problemType;
-      boost::array<unsigned, 4> expectedValues;
-      Problems<unsigned > iProblems;
-      Problems<char> sProblems;
+      Batch batch;
 
       boost::system::error_code error;
       boost::array<unsigned, 1> buf;
@@ -165,43 +490,15 @@ int main(int argc, char *argv[]) {
       else if (error)
           throw boost::system::system_error(error); // Some other error.
 
-      problemType = buf.front();
-      
-      if (problemType < PASSWORD)
-          getProblems<unsigned>(socket, problemType, iProblems, expectedValues);
-      else
-          getProblems<char>(socket, problemType, sProblems, expectedValues);
-
+      readBatch(socket, buf.front(), 4, batch);
+      Answers answers = solve(batch);
       boost::array<bool, 4> answer_buf;
-      switch (problemType)
-      {
-      case MAZE:
-          answer_buf = handleMazeProblem(iProblems);
-          break;
-      case SUDOKU:
-          answer_buf = handleSudokuProblem(iProblems);
-          break;
-      case TREE:
-          answer_buf = handleTreeProblem(iProblems);
-          break;
-      case ARRAY:
-          answer_buf = handleArrayProblem(iProblems, expectedValues);
-          break;
-      case PASSWORD:
-          answer_buf = handlePasswordProblem(sProblems);
-          break;
-      case RLE:
-          answer_buf = handleRLEProblem(sProblems, expectedValues);
-          break;
-      }
-      
+      std::copy(answers.begin(), answers.end(), answer_buf.begin());
+
       // send it back
       std::cout << "Sending answers" << std::endl;
       socket.send(boost::asio::buffer(answer_buf));
-      if (uniform_dist(e1))
-        this_thread::sleep_for(chrono::milliseconds(100));
-      else
-        this_thread::sleep_for(chrono::milliseconds(6000));
+      thinkAboutIt();
       // and here we go again !
     }
   } catch (std::exception &e) {
@@ -0,0 +1,273 @@
+#include "dataset.h"
+#include "lz.h"
+#include "page_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+uint64_t checksumBytes(const void *data, size_t size) {
+  auto bytes = static_cast<const unsigned char *>(data);
+  uint64_t hash = 0xcbf29ce484222325ULL ^ size;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, bytes + i, sizeof(word));
+    hash ^= word;
+    hash *= 0x100000001b3ULL;
+    hash ^= hash >> 29;
+  }
+  for (; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+static uint32_t checksumPayload(boost::asio::const_buffer payload) {
+  uint64_t hash = checksumBytes(boost::asio::buffer_cast<const void *>(payload),
+                                boost::asio::buffer_size(payload));
+  return static_cast<uint32_t>(hash ^ (hash >> 32));
+}
+
+static uint64_t checksumHeader(const DatasetHeader &header) {
+  return checksumBytes(&header, offsetof(DatasetHeader, headerChecksum));
+}
+
+static uint64_t alignUp(uint64_t offset) {
+  return (offset + DATASET_ALIGNMENT - 1) / DATASET_ALIGNMENT * DATASET_ALIGNMENT;
+}
+
+bool isDataset(const MappedFile &file) {
+  return file.size() >= sizeof(DATASET_MAGIC) &&
+         std::memcmp(file.data(), DATASET_MAGIC, sizeof(DATASET_MAGIC)) == 0;
+}
+
+unsigned getGroupWidth(const MappedFile &file) {
+  if (isDataset(file))
+    return 0;
+
+  int width = 4;
+  if (file.size() >= sizeof(WIDE_SET_MAGIC) + sizeof(width) &&
+      std::memcmp(file.data(), WIDE_SET_MAGIC, sizeof(WIDE_SET_MAGIC)) == 0)
+    std::memcpy(&width, file.data() + sizeof(WIDE_SET_MAGIC), sizeof(width));
+  return width > 0 ? static_cast<unsigned>(width) : 4;
+}
+
+bool writeDataset(const std::string &name, ProblemType type, const ProblemArena &arena) {
+  std::string partial = name + ".partial";
+  std::ofstream out(partial, std::ios::binary | std::ios::trunc);
+  if (!out)
+    return false;
+
+  DatasetHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, DATASET_MAGIC, sizeof(DATASET_MAGIC));
+  header.version = DATASET_VERSION;
+  header.category = type;
+  header.problems = static_cast<uint32_t>(arena.size());
+  header.indexOffset = sizeof(DatasetHeader);
+  header.payloadOffset = alignUp(header.indexOffset + arena.size() * sizeof(DatasetEntry));
+
+  // Payloads first, the index is written once their offsets are known
+  static const char padding[DATASET_ALIGNMENT] = {};
+  out.seekp(header.payloadOffset);
+  uint64_t offset = header.payloadOffset;
+  std::vector<DatasetEntry> index(arena.size());
+  std::unordered_map<const void *, size_t> written;
+  for (size_t i = 0; i < arena.size(); ++i) {
+    DatasetEntry &entry = index[i];
+    std::memset(&entry, 0, sizeof(entry));
+    entry.length = arena.getLength(i);
+    entry.answer = arena.getAnswer(i);
+    boost::optional<unsigned> expected = arena.getExpectedValue(i);
+    entry.hasExpectedValue = expected ? 1 : 0;
+    entry.expectedValue = expected ? static_cast<int32_t>(expected.get()) : 0;
+
+    // Problems the arena shares payloads between share them in the file too
+    const void *plain = boost::asio::buffer_cast<const void *>(arena.getPayload(PLAIN_WIRE, i));
+    auto shared = written.emplace(plain, i);
+    if (!shared.second) {
+      std::memcpy(entry.payloads, index[shared.first->second].payloads, sizeof(entry.payloads));
+      continue;
+    }
+    for (int encoding = 0; encoding < NB_WIRE_ENCODINGS; ++encoding) {
+      boost::asio::const_buffer payload = arena.getPayload(static_cast<WireEncoding>(encoding), i);
+      size_t bytes = boost::asio::buffer_size(payload);
+      entry.payloads[encoding].offset = offset;
+      entry.payloads[encoding].bytes = static_cast<uint32_t>(bytes);
+      entry.payloads[encoding].checksum = checksumPayload(payload);
+      out.write(boost::asio::buffer_cast<const char *>(payload), bytes);
+      uint64_t next = alignUp(offset + bytes);
+      out.write(padding, next - offset - bytes);
+      offset = next;
+    }
+  }
+
+  header.fileSize = offset;
+  header.indexChecksum = checksumBytes(index.data(), index.size() * sizeof(DatasetEntry));
+  header.headerChecksum = checksumHeader(header);
+  out.seekp(0);
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char *>(index.data()), index.size() * sizeof(DatasetEntry));
+  out.close();
+  if (!out || std::rename(partial.c_str(), name.c_str()) != 0) {
+    std::remove(partial.c_str());
+    return false;
+  }
+  return true;
+}
+
+// Whether a dataset header is whole and its index within the file
+static bool checkHeader(const DatasetHeader &header, uint64_t fileSize) {
+  return std::memcmp(header.magic, DATASET_MAGIC, sizeof(DATASET_MAGIC)) == 0 &&
+         header.version == DATASET_VERSION && header.headerChecksum == checksumHeader(header) &&
+         header.fileSize == fileSize && header.category < ProblemType::NB_ELEMS &&
+         header.indexOffset <= fileSize &&
+         header.problems <= (fileSize - header.indexOffset) / sizeof(DatasetEntry);
+}
+
+static bool checkIndex(const char *index, const DatasetHeader &header) {
+  return header.indexChecksum == checksumBytes(index, header.problems * sizeof(DatasetEntry));
+}
+
+// The header of a mapped dataset, if it and the index are whole
+static bool readHeader(const MappedFile &file, DatasetHeader &header) {
+  if (file.size() < sizeof(header))
+    return false;
+  std::memcpy(&header, file.data(), sizeof(header));
+  return checkHeader(header, file.size()) && checkIndex(file.data() + header.indexOffset, header);
+}
+
+static bool readEntry(const char *index, const DatasetHeader &header, size_t i,
+                      DatasetEntry &entry) {
+  std::memcpy(&entry, index + i * sizeof(DatasetEntry), sizeof(entry));
+  if (entry.payloads[PLAIN_WIRE].bytes != uint64_t(entry.length) * sizeof(unsigned) ||
+      entry.payloads[PLAIN_WIRE].offset % DATASET_ALIGNMENT != 0)
+    return false;
+  for (auto &payload : entry.payloads) {
+    if (payload.offset < header.payloadOffset || payload.offset > header.fileSize ||
+        payload.bytes > header.fileSize - payload.offset)
+      return false;
+  }
+  return true;
+}
+
+// Adds the share of the problems of a shard to the arena, false if an
+// entry of the index is damaged
+static bool addProblems(const char *index, const DatasetHeader &header, ProblemArena &arena,
+                        LoadStats &stats, unsigned shard, unsigned shards) {
+  bool complete = true;
+  for (size_t i = shard; i < header.problems; i += shards) {
+    DatasetEntry entry;
+    if (!readEntry(index, header, i, entry)) {
+      complete = false;
+      break;
+    }
+
+    MappedProblem problem;
+    problem.answer = entry.answer != 0;
+    if (entry.hasExpectedValue)
+      problem.expectedValue = entry.expectedValue;
+    problem.size = entry.length;
+    for (int encoding = 0; encoding < NB_WIRE_ENCODINGS; ++encoding) {
+      problem.offsets[encoding] = entry.payloads[encoding].offset;
+      problem.bytes[encoding] = entry.payloads[encoding].bytes;
+    }
+    size_t duplicates = arena.getDuplicates();
+    arena.addMappedProblem(problem);
+    ++stats.problems;
+    if (arena.getDuplicates() == duplicates) {
+      stats.distinctBytes += entry.payloads[PLAIN_WIRE].bytes;
+      stats.packedBytes += entry.payloads[PACKED_WIRE].bytes;
+      stats.compressedBytes += entry.payloads[COMPRESSED_WIRE].bytes;
+      stats.packedCompressedBytes += entry.payloads[PACKED_COMPRESSED_WIRE].bytes;
+    }
+  }
+
+  arena.finishMapping();
+  stats.duplicates = arena.getDuplicates();
+  stats.savedBytes = arena.getSavedBytes();
+  return complete;
+}
+
+bool mapDataset(const std::shared_ptr<const MappedFile> &file, ProblemType type,
+                ProblemArena &arena, LoadStats &stats, bool compress,
+                unsigned shard, unsigned shards) {
+  DatasetHeader header;
+  if (!readHeader(*file, header) || header.category != static_cast<uint32_t>(type))
+    return false;
+
+  arena.mapFrom(file);
+  bool complete = addProblems(file->data() + header.indexOffset, header, arena, stats, shard,
+                              shards);
+  if (compress) {
+    try {
+      stats.decodeMilliseconds = arena.measureDecoding();
+    } catch (const std::logic_error &) {
+      complete = false;
+    }
+  } else {
+    stats.compressedBytes = 0;
+    stats.packedCompressedBytes = 0;
+  }
+  return complete;
+}
+
+bool pageDataset(const std::string &name, PageCache &pages, ProblemType type,
+                 ProblemArena &arena, LoadStats &stats, bool compress,
+                 unsigned shard, unsigned shards) {
+  std::shared_ptr<PagedFile> file = pages.open(name);
+  DatasetHeader header;
+  if (!file || !file->read(0, &header, sizeof(header)) || !checkHeader(header, file->size()) ||
+      header.category != static_cast<uint32_t>(type))
+    return false;
+
+  // Only the index is read, it is dropped once the arena has what it needs
+  std::vector<char> index(header.problems * sizeof(DatasetEntry));
+  if (!file->read(header.indexOffset, index.data(), index.size()) ||
+      !checkIndex(index.data(), header))
+    return false;
+
+  arena.pageFrom(file);
+  bool complete = addProblems(index.data(), header, arena, stats, shard, shards);
+  if (!compress) {
+    stats.compressedBytes = 0;
+    stats.packedCompressedBytes = 0;
+  }
+  return complete;
+}
+
+bool checkDataset(const MappedFile &file, size_t &damaged) {
+  DatasetHeader header;
+  if (!readHeader(file, header))
+    return false;
+
+  damaged = 0;
+  std::vector<unsigned char> decoded;
+  for (size_t i = 0; i < header.problems; ++i) {
+    DatasetEntry entry;
+    bool valid = readEntry(file.data() + header.indexOffset, header, i, entry);
+    for (int encoding = 0; valid && encoding < NB_WIRE_ENCODINGS; ++encoding) {
+      const DatasetPayload &payload = entry.payloads[encoding];
+      valid = checksumPayload(boost::asio::buffer(file.data() + payload.offset, payload.bytes)) ==
+              payload.checksum;
+    }
+
+    // The compressed payloads decode to the plain and the packed ones
+    for (int encoding = COMPRESSED_WIRE; valid && encoding < NB_WIRE_ENCODINGS; encoding += 2) {
+      const DatasetPayload &original = entry.payloads[encoding - 1];
+      const DatasetPayload &compressed = entry.payloads[encoding];
+      decoded.resize(original.bytes);
+      valid = lzDecompress(file.data() + compressed.offset, compressed.bytes, decoded.data(),
+                           decoded.size()) &&
+              std::equal(decoded.begin(), decoded.end(),
+                         reinterpret_cast<const unsigned char *>(file.data()) + original.offset);
+    }
+    damaged += !valid;
+  }
+  return true;
+}
@@ -0,0 +1,100 @@
+#ifndef DATASET_H
+#define DATASET_H
+
+#include "problems.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Problem sets in the indexed format, version 2 of the set files. Where a
+// .bin set has to be walked and widened before it can be served, a dataset
+// holds every problem already in each wire encoding, so the server maps it
+// and sends payloads straight out of the page cache. All values are
+// little-endian:
+//   header   64 bytes, DatasetHeader
+//   index    one DatasetEntry per problem, problem i at indexOffset + 80 i
+//   payloads each starting on a 64-byte boundary, the four encodings of a
+//            problem one after the other; problems with identical payloads
+//            share them
+// The header and the index carry checksums, checked when a dataset is
+// loaded, and each payload its own, checked by `DatasetConverter --check`.
+// Datasets are read in place while served, so replace one by renaming a
+// new file over it rather than rewriting it.
+
+const char DATASET_MAGIC[4] = { 'C', 'S', 'G', 'D' };
+const uint32_t DATASET_VERSION = 2;
+const size_t DATASET_ALIGNMENT = 64;
+
+struct DatasetHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t category;
+  uint32_t problems;
+  uint64_t indexOffset;
+  uint64_t payloadOffset;
+  uint64_t fileSize;
+  uint64_t indexChecksum;
+  uint8_t reserved[8];
+  // Of the bytes above
+  uint64_t headerChecksum;
+};
+
+// Where a payload in one encoding lies, as it goes on the wire after the
+// header of its encoding
+struct DatasetPayload {
+  uint64_t offset;
+  uint32_t bytes;
+  uint32_t checksum;
+};
+
+struct DatasetEntry {
+  // Elements of the problem, widened to 32 bits on the plain wire
+  uint32_t length;
+  int32_t expectedValue;
+  uint8_t answer;
+  uint8_t hasExpectedValue;
+  uint8_t reserved[6];
+  DatasetPayload payloads[NB_WIRE_ENCODINGS];
+};
+
+static_assert(sizeof(DatasetHeader) == 64, "the dataset header is 64 bytes");
+static_assert(sizeof(DatasetEntry) == 80, "dataset entries are 80 bytes");
+
+// FNV-1a over 64-bit words, then the remaining bytes
+uint64_t checksumBytes(const void *data, size_t size);
+
+bool isDataset(const MappedFile &file);
+
+// Problems per group of a set in the original format, which passwords are
+// judged within; 0 for a dataset, which does not keep it
+unsigned getGroupWidth(const MappedFile &file);
+
+// Writes the problems of an arena, in every encoding, as a dataset. The
+// arena must have been compressed. The file is written next to `name` and
+// renamed over it once complete, so a server mapping the previous one keeps
+// serving it.
+bool writeDataset(const std::string &name, ProblemType type, const ProblemArena &arena);
+
+// Serves problem `shard` of a dataset and every `shards`-th one after it
+// from the mapping, checking the header and the index. Returns false if the
+// dataset is of another category or damaged, keeping the problems found
+// before the damage.
+bool mapDataset(const std::shared_ptr<const MappedFile> &file, ProblemType type,
+                ProblemArena &arena, LoadStats &stats, bool compress,
+                unsigned shard, unsigned shards);
+
+// Same as mapDataset, but the problems are read a page at a time through
+// the page cache as they are sent, and only the index is read now. The
+// compressed payloads are not checked against the others.
+bool pageDataset(const std::string &name, PageCache &pages, ProblemType type,
+                 ProblemArena &arena, LoadStats &stats, bool compress,
+                 unsigned shard, unsigned shards);
+
+// Counts the problems of a dataset whose payloads do not match their
+// checksums, or whose compressed payloads do not decode to the others.
+// Reads the whole file; false if the header or the index is damaged.
+bool checkDataset(const MappedFile &file, size_t &damaged);
+
+#endif // DATASET_H
@@ -0,0 +1,102 @@
+#include "dataset.h"
+#include "problems.h"
+
+#include <boost/program_options.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace po = boost::program_options;
+
+namespace {
+
+// maze_small.bin becomes maze_small.csgd
+std::string datasetNameOf(const std::string &name) {
+  const std::string extension = ".bin";
+  if (name.size() > extension.size() &&
+      name.compare(name.size() - extension.size(), extension.size(), extension) == 0)
+    return name.substr(0, name.size() - extension.size()) + ".csgd";
+  return name + ".csgd";
+}
+
+bool convert(const std::string &input, const std::string &output, ProblemType type) {
+  ProblemContainer problems;
+  LoadStats stats = readProblem(input, type, problems, true);
+  printLoadStats(stats, std::cout);
+  if (!writeDataset(output, type, problems.getArena(type))) {
+    std::cerr << "Could not write " << output << std::endl;
+    return false;
+  }
+
+  MappedFile dataset(output);
+  std::cout << output << ": " << getProblemTypeName(type) << " dataset of " << stats.problems
+            << " problems, " << dataset.size() / 1024 << " KiB" << std::endl;
+  return true;
+}
+
+bool check(const std::string &name) {
+  MappedFile dataset(name);
+  size_t damaged;
+  if (!isDataset(dataset) || !checkDataset(dataset, damaged)) {
+    std::cerr << name << ": not a dataset, or its header or index is damaged" << std::endl;
+    return false;
+  }
+  if (damaged) {
+    std::cerr << name << ": " << damaged << " problems have damaged payloads" << std::endl;
+    return false;
+  }
+  std::cout << name << ": ok" << std::endl;
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string category, output;
+  po::options_description desc("Usage: DatasetConverter [options] set.bin...\n"
+                               "Converts problem sets to indexed datasets, see dataset.h\nOptions");
+  desc.add_options()
+    ("help", "print this message")
+    ("category", po::value<std::string>(&category), "category of the sets, guessed from their names otherwise")
+    ("output", po::value<std::string>(&output), "name of the dataset when converting a single set, set.csgd otherwise")
+    ("check", "check the checksums of every payload of the given datasets instead")
+    ("sets", po::value<std::vector<std::string>>(), "problem sets");
+  po::positional_options_description positional;
+  positional.add("sets", -1);
+
+  po::variables_map vm;
+  try {
+    po::store(po::command_line_parser(argc, argv).options(desc).positional(positional).run(), vm);
+    po::notify(vm);
+  } catch (po::error &e) {
+    std::cerr << e.what() << std::endl << desc << std::endl;
+    return 1;
+  }
+  if (vm.count("help") || !vm.count("sets")) {
+    std::cout << desc << std::endl;
+    return vm.count("help") ? 0 : 1;
+  }
+
+  const std::vector<std::string> &sets = vm["sets"].as<std::vector<std::string>>();
+  if (!output.empty() && sets.size() != 1) {
+    std::cerr << "--output only goes with a single set" << std::endl;
+    return 1;
+  }
+
+  bool success = true;
+  for (auto &name : sets) {
+    if (vm.count("check")) {
+      success &= check(name);
+      continue;
+    }
+
+    ProblemType type;
+    if (category.empty() ? !guessProblemType(name, type) : !parseProblemType(category, type)) {
+      std::cerr << "No category for " << name << ", give one with --category" << std::endl;
+      return 1;
+    }
+    success &= convert(name, output.empty() ? datasetNameOf(name) : output, type);
+  }
+  return success ? 0 : 1;
+}
@@ -0,0 +1,204 @@
+#include "generator.h"
+#include "problems.h"
+#include "sampler.h"
+
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace po = boost::program_options;
+
+namespace {
+
+void appendInt(std::string &out, int value) {
+  char bytes[sizeof(value)];
+  std::memcpy(bytes, &value, sizeof(value));
+  out.append(bytes, sizeof(value));
+}
+
+// Appends a batch as a group of a problem set, the way scanProblems reads
+// it: the answer flags, the expected value of RLE groups, then each problem
+// with its size, and for arrays the expected value counted in the size
+void appendGroup(const GeneratedBatch &batch, std::string &out) {
+  std::string flags((batch.width + 7) / 8, '\0');
+  for (unsigned i = 0; i < batch.width; ++i)
+    if (batch.answers[i / 32] & (1u << (i % 32)))
+      flags[i / 8] |= static_cast<char>(1 << (i % 8));
+  out += flags;
+
+  bool hasExpectedValue = batch.type == ARRAY || batch.type == RLE;
+  const unsigned *problem = batch.wire.data();
+  for (unsigned i = 0; i < batch.width; ++i) {
+    int expected = hasExpectedValue ? static_cast<int>(*problem++) : 0;
+    unsigned size = *problem++;
+    if (batch.type == RLE && i == 0)
+      appendInt(out, expected);
+    if (batch.type == ARRAY) {
+      appendInt(out, static_cast<int>(size + 1));
+      appendInt(out, expected);
+    } else {
+      appendInt(out, static_cast<int>(size));
+    }
+
+    if (batch.type == PASSWORD || batch.type == RLE) {
+      for (unsigned j = 0; j < size; ++j)
+        out.push_back(static_cast<char>(problem[j]));
+    } else {
+      for (unsigned j = 0; j < size; ++j)
+        appendInt(out, static_cast<int>(problem[j]));
+    }
+    problem += size;
+  }
+}
+
+struct Group {
+  std::string bytes;
+  size_t trueAnswers;
+};
+
+// Writes `groups` groups of a category. Each group is generated from a seed
+// of its own, so a set comes out the same whatever the number of threads;
+// threads generate a round of groups at a time, written out in order.
+bool writeSet(const std::string &name, ProblemType type, size_t groups, unsigned width,
+              const ProblemSizes &sizes, unsigned seed, unsigned threads) {
+  auto start = std::chrono::steady_clock::now();
+  std::ofstream out(name, std::ios::binary | std::ios::trunc);
+  if (!out)
+    return false;
+  if (width != 4) {
+    out.write(WIDE_SET_MAGIC, sizeof(WIDE_SET_MAGIC));
+    int header = static_cast<int>(width);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  }
+
+  size_t bytes = 0, trueAnswers = 0;
+  std::vector<Group> round(threads * 4);
+  for (size_t first = 0; first < groups; first += round.size()) {
+    size_t count = std::min(round.size(), groups - first);
+    std::atomic<size_t> next(0);
+    auto generate = [&] {
+      for (size_t i; (i = next.fetch_add(1)) < count;) {
+        std::seed_seq seq{ seed, static_cast<unsigned>(type),
+                           static_cast<unsigned>(first + i),
+                           static_cast<unsigned>((first + i) >> 32) };
+        std::default_random_engine engine(seq);
+        std::unique_ptr<GeneratedBatch> batch = generateBatch(type, width, engine, sizes);
+
+        Group &group = round[i];
+        group.bytes.clear();
+        appendGroup(*batch, group.bytes);
+        group.trueAnswers = 0;
+        for (uint32_t word : batch->answers)
+          group.trueAnswers += __builtin_popcount(word);
+      }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned t = 1; t < std::min<size_t>(threads, count); ++t)
+      workers.emplace_back(generate);
+    generate();
+    for (auto &worker : workers)
+      worker.join();
+
+    for (size_t i = 0; i < count; ++i) {
+      out.write(round[i].bytes.data(), round[i].bytes.size());
+      bytes += round[i].bytes.size();
+      trueAnswers += round[i].trueAnswers;
+    }
+  }
+  if (!out.flush())
+    return false;
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  size_t problems = groups * width;
+  std::cout << std::fixed << std::setprecision(1) << name << ": " << problems << " problems, "
+            << bytes / (1024. * 1024.) << " MiB in " << seconds << " s ("
+            << bytes / (seconds * 1e6 + 1e-9) << " MB/s), "
+            << 100. * trueAnswers / std::max<size_t>(problems, 1) << "% true" << std::endl;
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string outputDir, suffix, categories;
+  size_t problems;
+  unsigned width, threads;
+  po::options_description desc("Usage: DatasetGenerator [options] [output directory]\nOptions");
+  desc.add_options()
+    ("help", "print this message")
+    ("problems", po::value<size_t>(&problems)->default_value(1000), "problems per category, rounded up to whole groups")
+    ("width", po::value<unsigned>(&width)->default_value(4), "problems per group, 4 for the original format")
+    ("sizes", po::value<std::vector<std::string>>(), "size classes to draw from, as maze=4K:1,16K:3 or maze=largest (repeatable)")
+    ("categories", po::value<std::string>(&categories)->default_value("maze,sudoku,tree,array,password,RLE"), "categories to write a set for")
+    ("suffix", po::value<std::string>(&suffix)->default_value("eval"), "sets are named <category>_<suffix>.bin")
+    ("threads", po::value<unsigned>(&threads)->default_value(std::max(1u, std::thread::hardware_concurrency())), "generator threads")
+    ("seed", po::value<unsigned>(), "seed, random when left out")
+    ("output-dir", po::value<std::string>(&outputDir)->default_value("."), "where to write the sets");
+  po::positional_options_description positional;
+  positional.add("output-dir", 1);
+
+  po::variables_map vm;
+  try {
+    po::store(po::command_line_parser(argc, argv).options(desc).positional(positional).run(), vm);
+    po::notify(vm);
+  } catch (po::error &e) {
+    std::cerr << e.what() << std::endl << desc << std::endl;
+    return 1;
+  }
+  if (vm.count("help")) {
+    std::cout << desc << std::endl;
+    return 0;
+  }
+  if (width == 0 || width > MAX_BATCH_WIDTH) {
+    std::cerr << "Groups hold 1 to " << MAX_BATCH_WIDTH << " problems" << std::endl;
+    return 1;
+  }
+  threads = std::max(1u, threads);
+
+  SamplerConfig config;
+  if (vm.count("sizes")) {
+    for (auto &sizes : vm["sizes"].as<std::vector<std::string>>()) {
+      if (!parseSizeWeights(sizes, config)) {
+        std::cerr << "Bad size classes " << sizes << std::endl;
+        return 1;
+      }
+    }
+  }
+  ProblemSizes sizes(config);
+
+  std::vector<ProblemType> types;
+  std::istringstream names(categories);
+  for (std::string name; std::getline(names, name, ',');) {
+    ProblemType type;
+    if (!parseProblemType(name, type)) {
+      std::cerr << "Unknown category " << name << std::endl;
+      return 1;
+    }
+    types.push_back(type);
+  }
+
+  unsigned seed = vm.count("seed") ? vm["seed"].as<unsigned>() : std::random_device()();
+  std::cout << "Seed " << seed << ", " << threads << " threads" << std::endl;
+
+  size_t groups = (problems + width - 1) / width;
+  for (ProblemType type : types) {
+    std::string name = outputDir + "/" + getProblemTypeName(type) + "_" + suffix + ".bin";
+    if (!writeSet(name, type, groups, width, sizes, seed, threads)) {
+      std::cerr << "Could not write " << name << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,201 @@
+#include "dataset.h"
+#include "problems.h"
+#include "solvers.h"
+
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace po = boost::program_options;
+
+namespace {
+
+struct Options {
+  unsigned threads;
+  unsigned width;
+  unsigned rounds;
+  size_t maxReports;
+};
+
+struct Totals {
+  size_t problems = 0;
+  size_t mismatches = 0;
+  size_t bytes = 0;
+  double milliseconds = 0.;
+};
+
+// Solves every problem of an arena on `threads` threads, which take a few
+// groups at a time so large problems do not leave the others idle, and
+// returns how long that took in milliseconds
+double solveAll(ProblemType type, const ProblemArena &arena, unsigned width,
+                unsigned threads, std::vector<unsigned char> &answers) {
+  const size_t chunk = std::max<size_t>(1, 64 / width) * width;
+  std::atomic<size_t> next(0);
+  answers.assign(arena.size(), 0);
+  auto work = [&]() {
+    for (;;) {
+      size_t first = next.fetch_add(chunk, std::memory_order_relaxed);
+      if (first >= arena.size())
+        return;
+      size_t count = std::min(chunk, arena.size() - first);
+      solveProblems(type, arena, first, count, width, &answers[first]);
+    }
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> pool;
+  for (unsigned i = 1; i < threads; ++i)
+    pool.emplace_back(work);
+  work();
+  for (auto &thread : pool)
+    thread.join();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// Problems of a group should share their expected value when the format
+// only stores one per group
+size_t checkExpectedValues(const std::string &name, ProblemType type, const ProblemArena &arena,
+                           unsigned width) {
+  if (type != ARRAY && type != RLE)
+    return 0;
+  if (arena.size() && !arena.getExpectedValue(0)) {
+    std::cout << name << ": " << getProblemTypeName(type)
+              << " problems without expected values" << std::endl;
+    return arena.size();
+  }
+  if (type != RLE)
+    return 0;
+
+  size_t mixed = 0;
+  for (size_t first = 0; first < arena.size(); first += width) {
+    size_t end = std::min<size_t>(first + width, arena.size());
+    for (size_t i = first + 1; i < end; ++i) {
+      if (arena.getExpectedValue(i) != arena.getExpectedValue(first)) {
+        std::cout << name << ": group " << first / width << " has more than one expected value"
+                  << std::endl;
+        ++mixed;
+        break;
+      }
+    }
+  }
+  return mixed;
+}
+
+bool validate(const std::string &name, ProblemType type, const Options &options,
+              Totals &totals) {
+  ProblemContainer problems;
+  readProblem(name, type, problems, false);
+  const ProblemArena &arena = problems.getArena(type);
+  if (arena.size() == 0) {
+    std::cerr << name << ": no " << getProblemTypeName(type) << " problems" << std::endl;
+    return false;
+  }
+
+  unsigned width = getGroupWidth(MappedFile(name));
+  if (width == 0)
+    width = options.width;
+  size_t bytes = 0;
+  for (size_t i = 0; i < arena.size(); ++i)
+    bytes += arena.getLength(i) * (type < PASSWORD ? sizeof(int) : sizeof(char));
+
+  // The fastest round, the others warming the caches up
+  std::vector<unsigned char> answers;
+  double milliseconds = 0.;
+  for (unsigned round = 0; round < options.rounds; ++round) {
+    double elapsed = solveAll(type, arena, width, options.threads, answers);
+    milliseconds = round == 0 ? elapsed : std::min(milliseconds, elapsed);
+  }
+
+  size_t mismatches = checkExpectedValues(name, type, arena, width);
+  size_t reported = 0;
+  for (size_t i = 0; i < arena.size(); ++i) {
+    bool solved = answers[i] != 0;
+    if (solved == arena.getAnswer(i))
+      continue;
+    if (reported++ < options.maxReports) {
+      std::cout << name << ": problem " << i << " (group " << i / width << ") is flagged "
+                << std::boolalpha << arena.getAnswer(i) << " but solves to " << solved;
+      if (arena.getExpectedValue(i))
+        std::cout << ", expected value " << static_cast<int>(arena.getExpectedValue(i).get());
+      std::cout << std::endl;
+    }
+  }
+  if (reported > options.maxReports)
+    std::cout << name << ": " << reported - options.maxReports << " more mismatches"
+              << std::endl;
+  mismatches += reported;
+
+  std::cout << std::fixed << std::setprecision(1) << name << ": " << arena.size() << " "
+            << getProblemTypeName(type) << " problems, " << mismatches << " mismatches, solved in "
+            << milliseconds << " ms on " << options.threads << " threads ("
+            << arena.size() / (milliseconds / 1000. + 1e-9) << " problems/s, "
+            << bytes / (milliseconds * 1000. + 1e-9) << " MB/s)" << std::endl;
+
+  totals.problems += arena.size();
+  totals.mismatches += mismatches;
+  totals.bytes += bytes;
+  totals.milliseconds += milliseconds;
+  return mismatches == 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string category;
+  Options options;
+  po::options_description desc("Usage: DatasetValidator [options] set...\n"
+                               "Solves every problem of problem sets or datasets and checks their answers\nOptions");
+  desc.add_options()
+    ("help", "print this message")
+    ("category", po::value<std::string>(&category), "category of the sets, guessed from their names otherwise")
+    ("threads", po::value<unsigned>(&options.threads)->default_value(std::max(1u, std::thread::hardware_concurrency())), "threads solving each set")
+    ("width", po::value<unsigned>(&options.width)->default_value(4), "problems per group of password datasets, which do not record it")
+    ("rounds", po::value<unsigned>(&options.rounds)->default_value(1), "solve each set this many times and keep the fastest")
+    ("max-reports", po::value<size_t>(&options.maxReports)->default_value(10), "mismatches listed per set")
+    ("sets", po::value<std::vector<std::string>>(), "problem sets or datasets");
+  po::positional_options_description positional;
+  positional.add("sets", -1);
+
+  po::variables_map vm;
+  try {
+    po::store(po::command_line_parser(argc, argv).options(desc).positional(positional).run(), vm);
+    po::notify(vm);
+  } catch (po::error &e) {
+    std::cerr << e.what() << std::endl << desc << std::endl;
+    return 1;
+  }
+  if (vm.count("help") || !vm.count("sets")) {
+    std::cout << desc << std::endl;
+    return vm.count("help") ? 0 : 1;
+  }
+  if (options.threads == 0 || options.width == 0 || options.rounds == 0) {
+    std::cerr << "--threads, --width and --rounds must be at least 1" << std::endl;
+    return 1;
+  }
+
+  bool success = true;
+  Totals totals;
+  for (auto &name : vm["sets"].as<std::vector<std::string>>()) {
+    ProblemType type;
+    if (category.empty() ? !guessProblemType(name, type) : !parseProblemType(category, type)) {
+      std::cerr << "No category for " << name << ", give one with --category" << std::endl;
+      return 1;
+    }
+    success &= validate(name, type, options, totals);
+  }
+
+  std::cout << std::fixed << std::setprecision(1) << "Total: " << totals.problems
+            << " problems, " << totals.mismatches << " mismatches, solved in "
+            << totals.milliseconds << " ms (" << totals.problems / (totals.milliseconds / 1000. + 1e-9)
+            << " problems/s, " << totals.bytes / (totals.milliseconds * 1000. + 1e-9) << " MB/s)"
+            << std::endl;
+  return success ? 0 : 1;
+}
@@ -0,0 +1,46 @@
+#include "deadline.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+DeadlineModel::DeadlineModel() : baseMilliseconds(250.), maxMilliseconds(60000.) {
+  // Room enough for a plain single-threaded solver, to be tightened as the
+  // clients get faster
+  nanosecondsPerElement[MAZE] = 2000.;
+  nanosecondsPerElement[SUDOKU] = 2000.;
+  nanosecondsPerElement[TREE] = 1000.;
+  nanosecondsPerElement[ARRAY] = 250.;
+  nanosecondsPerElement[PASSWORD] = 1000.;
+  nanosecondsPerElement[RLE] = 1000.;
+}
+
+uint64_t DeadlineModel::deadlineOf(ProblemType type, size_t elements) const {
+  double milliseconds = baseMilliseconds + elements * nanosecondsPerElement[type] / 1e6;
+  return static_cast<uint64_t>(std::max(1., std::ceil(std::min(milliseconds, maxMilliseconds))));
+}
+
+void DeadlineModel::print(std::ostream &out) const {
+  out << "Answer deadlines: " << baseMilliseconds << " ms";
+  for (int type = 0; type < ProblemType::NB_ELEMS; ++type)
+    out << ", " << getProblemTypeName(static_cast<ProblemType>(type)) << " +"
+        << nanosecondsPerElement[type] << " ns";
+  out << " per element, " << maxMilliseconds << " ms at most" << std::endl;
+}
+
+bool parseDeadlineCosts(const std::string &text, DeadlineModel &model) {
+  std::istringstream in(text);
+  for (std::string item; std::getline(in, item, ',');) {
+    size_t equal = item.find('=');
+    ProblemType type;
+    if (equal == std::string::npos || !parseProblemType(item.substr(0, equal), type))
+      return false;
+    std::istringstream cost(item.substr(equal + 1));
+    double nanoseconds;
+    if (!(cost >> nanoseconds) || !cost.eof() || nanoseconds < 0.)
+      return false;
+    model.nanosecondsPerElement[type] = nanoseconds;
+  }
+  return true;
+}
@@ -0,0 +1,33 @@
+#ifndef DEADLINE_H
+#define DEADLINE_H
+
+#include "problems.h"
+
+#include <boost/array.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// How long a client has to answer a batch: an allowance for the round trip
+// plus a cost per element that depends on the category, so a batch of tiny
+// sudokus and one of huge mazes are both held to the same pace. Deadlines
+// are whole milliseconds, capped so a runaway batch still times out.
+struct DeadlineModel {
+  DeadlineModel();
+
+  uint64_t deadlineOf(ProblemType type, size_t elements) const;
+
+  // Writes the allowance, the cost of every category and the cap
+  void print(std::ostream &out) const;
+
+  double baseMilliseconds;
+  boost::array<double, ProblemType::NB_ELEMS> nanosecondsPerElement;
+  double maxMilliseconds;
+};
+
+// Parses "maze=2000,array=100" into costs per element, in nanoseconds
+bool parseDeadlineCosts(const std::string &text, DeadlineModel &model);
+
+#endif // DEADLINE_H
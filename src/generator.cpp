@@ -0,0 +1,509 @@
+#include "generator.h"
+#include "lz.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <new>
+#include <utility>
+
+namespace {
+
+typedef std::default_random_engine Engine;
+
+int randomInt(Engine &engine, int low, int high) {
+  return std::uniform_int_distribution<int>(low, high)(engine);
+}
+
+bool coinFlip(Engine &engine) { return randomInt(engine, 0, 1) == 1; }
+
+// Appends a problem to the wire: [expected value] size data...
+template <class T>
+void appendProblem(GeneratedBatch &batch, const std::vector<T> &data,
+                   const unsigned *expectedValue = nullptr) {
+  if (expectedValue)
+    batch.wire.push_back(*expectedValue);
+  batch.wire.push_back(static_cast<unsigned>(data.size()));
+  for (T value : data)
+    batch.wire.push_back(static_cast<unsigned>(value));
+  batch.elements += data.size();
+}
+
+void setAnswer(GeneratedBatch &batch, unsigned index, bool answer) {
+  if (answer)
+    batch.answers[index / 32] |= 1u << (index % 32);
+}
+
+// Carves a perfect maze with a depth-first walk over the odd cells, so there
+// is exactly one path between any two of them
+std::vector<int> carveMaze(int side, Engine &engine) {
+  std::vector<int> maze(side * side, 0);
+  std::vector<std::pair<int, int>> stack{ { 1, 1 } };
+  maze[side + 1] = 1;
+
+  static const int moves[4][2] = { { 0, 2 }, { 2, 0 }, { 0, -2 }, { -2, 0 } };
+  while (!stack.empty()) {
+    int row = stack.back().first, col = stack.back().second;
+    int candidates[4], count = 0;
+    for (int i = 0; i < 4; ++i) {
+      int r = row + moves[i][0], c = col + moves[i][1];
+      if (r > 0 && r < side - 1 && c > 0 && c < side - 1 && !maze[r * side + c])
+        candidates[count++] = i;
+    }
+
+    if (count == 0) {
+      stack.pop_back();
+      continue;
+    }
+
+    const int *move = moves[candidates[randomInt(engine, 0, count - 1)]];
+    int r = row + move[0], c = col + move[1];
+    maze[(row + move[0] / 2) * side + col + move[1] / 2] = 1;
+    maze[r * side + c] = 1;
+    stack.emplace_back(r, c);
+  }
+  return maze;
+}
+
+// Cells of the path from the start to the end, both excluded
+std::vector<int> findPath(const std::vector<int> &maze, int side) {
+  int start = side + 1, goal = (side - 2) * side + side - 2;
+  std::vector<int> parent(maze.size(), -1);
+  std::deque<int> queue{ start };
+  parent[start] = start;
+  while (!queue.empty() && parent[goal] < 0) {
+    int cell = queue.front();
+    queue.pop_front();
+    for (int next : { cell - side, cell + side, cell - 1, cell + 1 }) {
+      if (maze[next] && parent[next] < 0) {
+        parent[next] = cell;
+        queue.push_back(next);
+      }
+    }
+  }
+
+  std::vector<int> path;
+  for (int cell = parent[goal]; cell != start; cell = parent[cell])
+    path.push_back(cell);
+  return path;
+}
+
+void generateMazes(GeneratedBatch &batch, Engine &engine, const ProblemSizes &sizes) {
+  for (unsigned i = 0; i < batch.width; ++i) {
+    // Carving needs an odd side
+    size_t elements = sizes.sample(MAZE, engine);
+    int side = elements ? std::max(5, static_cast<int>(std::sqrt(elements)) | 1)
+                        : 2 * randomInt(engine, 10, 40) + 1;
+    std::vector<int> maze = carveMaze(side, engine);
+    bool solvable = coinFlip(engine);
+    if (!solvable) {
+      std::vector<int> path = findPath(maze, side);
+      maze[path[randomInt(engine, 0, static_cast<int>(path.size()) - 1)]] = 0;
+    }
+    appendProblem(batch, maze);
+    setAnswer(batch, i, solvable);
+  }
+}
+
+// Shuffles groups of `k` consecutive indices among themselves, then the
+// indices within each group
+std::vector<int> shuffledBands(int k, Engine &engine) {
+  std::vector<int> bands(k), order;
+  for (int i = 0; i < k; ++i)
+    bands[i] = i;
+  std::shuffle(bands.begin(), bands.end(), engine);
+  for (int band : bands) {
+    std::vector<int> lines(k);
+    for (int i = 0; i < k; ++i)
+      lines[i] = band * k + i;
+    std::shuffle(lines.begin(), lines.end(), engine);
+    order.insert(order.end(), lines.begin(), lines.end());
+  }
+  return order;
+}
+
+void generateSudokus(GeneratedBatch &batch, Engine &engine, const ProblemSizes &sizes) {
+  for (unsigned i = 0; i < batch.width; ++i) {
+    // A grid of k^2 x k^2 cells
+    size_t elements = sizes.sample(SUDOKU, engine);
+    int k = elements ? std::max(2, static_cast<int>(std::lround(std::sqrt(std::sqrt(elements)))))
+                     : randomInt(engine, 3, 8);
+    int side = k * k;
+    std::vector<int> digits(side);
+    for (int d = 0; d < side; ++d)
+      digits[d] = d + 1;
+    std::shuffle(digits.begin(), digits.end(), engine);
+    std::vector<int> rows = shuffledBands(k, engine), cols = shuffledBands(k, engine);
+
+    // Shuffling a valid grid keeps it valid
+    std::vector<int> grid(side * side);
+    for (int r = 0; r < side; ++r)
+      for (int c = 0; c < side; ++c)
+        grid[r * side + c] = digits[(k * (rows[r] % k) + rows[r] / k + cols[c]) % side];
+
+    // Swapping two cells of a row repeats both values in their columns
+    bool valid = coinFlip(engine);
+    if (!valid) {
+      int row = randomInt(engine, 0, side - 1);
+      int first = randomInt(engine, 0, side - 1);
+      int second = (first + randomInt(engine, 1, side - 1)) % side;
+      std::swap(grid[row * side + first], grid[row * side + second]);
+    }
+    appendProblem(batch, grid);
+    setAnswer(batch, i, valid);
+  }
+}
+
+struct TreeNode {
+  int value;
+  int left, right;
+};
+
+// Random tree of `size` nodes, built by hanging each node under a random
+// free spot of the previous ones, the root being the first node
+void growTree(std::vector<TreeNode> &nodes, int size, Engine &engine) {
+  nodes.assign(1, TreeNode{ randomInt(engine, 1, 9), -1, -1 });
+  std::vector<std::pair<int, bool>> spots{ { 0, false }, { 0, true } };
+  for (int i = 1; i < size; ++i) {
+    size_t pick = std::uniform_int_distribution<size_t>(0, spots.size() - 1)(engine);
+    std::pair<int, bool> spot = spots[pick];
+    spots[pick] = spots.back();
+    spots.pop_back();
+
+    nodes.push_back(TreeNode{ randomInt(engine, 1, 9), -1, -1 });
+    (spot.second ? nodes[spot.first].right : nodes[spot.first].left) = i;
+    spots.emplace_back(i, false);
+    spots.emplace_back(i, true);
+  }
+}
+
+// Preorder with -1 for missing children, optionally of the mirror image
+void serializeTree(const std::vector<TreeNode> &nodes, int root, bool mirrored,
+                   std::vector<int> &out) {
+  std::vector<int> stack{ root };
+  while (!stack.empty()) {
+    int node = stack.back();
+    stack.pop_back();
+    if (node < 0) {
+      out.push_back(-1);
+      continue;
+    }
+    out.push_back(nodes[node].value);
+    int first = mirrored ? nodes[node].right : nodes[node].left;
+    int second = mirrored ? nodes[node].left : nodes[node].right;
+    stack.push_back(second);
+    stack.push_back(first);
+  }
+}
+
+void generateTrees(GeneratedBatch &batch, Engine &engine, const ProblemSizes &sizes) {
+  std::vector<TreeNode> nodes;
+  for (unsigned i = 0; i < batch.width; ++i) {
+    // Both serializations take 2n + 1 values for n nodes
+    size_t elements = sizes.sample(TREE, engine);
+    growTree(nodes, elements ? std::max<int>(1, static_cast<int>(elements / 4))
+                             : randomInt(engine, 1, 1000),
+             engine);
+    std::vector<int> tree{ randomInt(engine, 1, 9) };
+    serializeTree(nodes, 0, false, tree);
+    size_t mirrorStart = tree.size();
+    serializeTree(nodes, 0, true, tree);
+
+    // Any other value in the mirror image breaks the symmetry
+    bool symmetric = coinFlip(engine);
+    if (!symmetric) {
+      std::vector<size_t> values;
+      for (size_t v = mirrorStart; v < tree.size(); ++v)
+        if (tree[v] > 0)
+          values.push_back(v);
+      int &value = tree[values[std::uniform_int_distribution<size_t>(
+          0, values.size() - 1)(engine)]];
+      value = value % 9 + 1;
+    }
+    appendProblem(batch, tree);
+    setAnswer(batch, i, symmetric);
+  }
+}
+
+void generateArrays(GeneratedBatch &batch, Engine &engine, const ProblemSizes &sizes) {
+  std::uniform_int_distribution<int> values(0, 1 << 30);
+  for (unsigned i = 0; i < batch.width; ++i) {
+    size_t elements = sizes.sample(ARRAY, engine);
+    std::vector<int> array(elements ? elements : randomInt(engine, 256, 16384));
+    for (int &value : array)
+      value = values(engine);
+
+    bool present = coinFlip(engine);
+    unsigned expected;
+    if (present) {
+      expected = array[randomInt(engine, 0, static_cast<int>(array.size()) - 1)];
+    } else {
+      do
+        expected = values(engine);
+      while (std::find(array.begin(), array.end(), static_cast<int>(expected)) !=
+             array.end());
+    }
+    appendProblem(batch, array, &expected);
+    setAnswer(batch, i, present);
+  }
+}
+
+// Passwords are only odd ones out relative to the rest of the batch, so a
+// batch is built around one multiset of letters and a minority of strings
+// get one of their letters changed
+void generatePasswords(GeneratedBatch &batch, Engine &engine, const ProblemSizes &sizes) {
+  size_t elements = sizes.sample(PASSWORD, engine);
+  std::vector<char> base(elements ? std::max<size_t>(elements, 2) : randomInt(engine, 8, 64));
+  for (char &letter : base)
+    letter = static_cast<char>('a' + randomInt(engine, 0, 25));
+
+  std::vector<unsigned> indices(batch.width);
+  for (unsigned i = 0; i < batch.width; ++i)
+    indices[i] = i;
+  std::shuffle(indices.begin(), indices.end(), engine);
+  unsigned different = randomInt(engine, 0, (batch.width - 1) / 2);
+
+  std::vector<bool> answers(batch.width, false);
+  for (unsigned i = 0; i < different; ++i)
+    answers[indices[i]] = true;
+
+  for (unsigned i = 0; i < batch.width; ++i) {
+    std::vector<char> password(base);
+    if (answers[i]) {
+      char &letter = password[randomInt(engine, 0, static_cast<int>(password.size()) - 1)];
+      letter = static_cast<char>('a' + (letter - 'a' + randomInt(engine, 1, 25)) % 26);
+    }
+    std::shuffle(password.begin(), password.end(), engine);
+    for (char &letter : password)
+      if (coinFlip(engine))
+        letter = static_cast<char>(std::toupper(letter));
+
+    appendProblem(batch, password);
+    setAnswer(batch, i, answers[i]);
+  }
+}
+
+// Runs of 1 to 25 average 13 characters decoded for 2.6 encoded, so a string
+// of n characters decodes to about 5n
+void generateRLEs(GeneratedBatch &batch, Engine &engine, const ProblemSizes &sizes) {
+  size_t elements = sizes.sample(RLE, engine);
+  unsigned expected = elements ? static_cast<unsigned>(std::max<size_t>(5 * elements, 26))
+                               : 13 * randomInt(engine, 5, 200);
+  for (unsigned i = 0; i < batch.width; ++i) {
+    // Strings that do not match decode to a few characters more or less
+    bool matches = coinFlip(engine);
+    unsigned length = expected;
+    if (!matches)
+      length += coinFlip(engine) ? randomInt(engine, 1, 25) : -randomInt(engine, 1, 25);
+
+    std::vector<char> text;
+    for (unsigned left = length; left > 0;) {
+      unsigned count = std::min<unsigned>(left, randomInt(engine, 1, 25));
+      left -= count;
+      for (char digit : std::to_string(count))
+        text.push_back(digit);
+      text.push_back(static_cast<char>('a' + randomInt(engine, 0, 25)));
+    }
+    appendProblem(batch, text, &expected);
+    setAnswer(batch, i, matches);
+  }
+}
+
+} // namespace
+
+ProblemSizes::ProblemSizes(const SamplerConfig &config) {
+  for (int type = 0; type < ProblemType::NB_ELEMS; ++type) {
+    if (config.largestOnly[type]) {
+      std::vector<double> weights(ProblemSampler::NB_SIZE_CLASSES, 0.);
+      weights.back() = 1.;
+      mClasses[type] = AliasTable(weights);
+    } else if (!config.sizeWeights[type].empty()) {
+      mClasses[type] = AliasTable(config.sizeWeights[type]);
+    }
+  }
+}
+
+// Classes are named after their upper bound, a quarter of it being the
+// upper bound of the class below
+size_t ProblemSizes::lowerBoundOf(int sizeClass) {
+  return sizeClass ? upperBoundOf(sizeClass - 1) : 16;
+}
+
+size_t ProblemSizes::upperBoundOf(int sizeClass) {
+  return sizeClass < ProblemSampler::NB_SIZE_CLASSES - 1 ? size_t(256) << (2 * sizeClass)
+                                                         : size_t(4) << 20;
+}
+
+std::unique_ptr<GeneratedBatch> generateBatch(ProblemType type, unsigned width,
+                                              std::default_random_engine &engine,
+                                              const ProblemSizes &sizes) {
+  std::unique_ptr<GeneratedBatch> batch(new GeneratedBatch);
+  batch->type = type;
+  batch->width = width;
+  batch->answers.assign(answerWords(width), 0);
+  batch->elements = 0;
+
+  switch (type) {
+  case MAZE: generateMazes(*batch, engine, sizes); break;
+  case SUDOKU: generateSudokus(*batch, engine, sizes); break;
+  case TREE: generateTrees(*batch, engine, sizes); break;
+  case ARRAY: generateArrays(*batch, engine, sizes); break;
+  case PASSWORD: generatePasswords(*batch, engine, sizes); break;
+  case RLE: generateRLEs(*batch, engine, sizes); break;
+  default: break;
+  }
+  return batch;
+}
+
+namespace {
+
+void appendWords(const unsigned *words, size_t count, std::vector<unsigned char> &out) {
+  size_t start = out.size();
+  out.resize(start + count * sizeof(unsigned));
+  if (count)
+    std::memcpy(&out[start], words, count * sizeof(unsigned));
+}
+
+// Compresses `size` bytes after the size the framing announces (words for
+// v1, packed bytes for v2) and the compressed size
+void appendCompressed(unsigned announced, const void *data, size_t size,
+                      std::vector<unsigned char> &out) {
+  unsigned header[2] = { announced, 0 };
+  size_t start = out.size();
+  appendWords(header, 2, out);
+  header[1] = static_cast<unsigned>(lzCompress(data, size, out));
+  std::memcpy(&out[start + sizeof(unsigned)], &header[1], sizeof(unsigned));
+}
+
+} // namespace
+
+void encodeBatch(GeneratedBatch &batch, bool compress) {
+  for (auto &encoded : batch.encodedWire)
+    encoded.clear();
+
+  bool hasExpectedValue = batch.type == ARRAY || batch.type == RLE;
+  std::vector<unsigned char> packed;
+  const unsigned *problem = batch.wire.data();
+  for (unsigned i = 0; i < batch.width; ++i) {
+    const unsigned *expected = hasExpectedValue ? problem++ : nullptr;
+    unsigned size = *problem++;
+    packed.clear();
+    packPayload(batch.type, problem, size, packed);
+
+    for (auto encoding : { PACKED_WIRE, COMPRESSED_WIRE, PACKED_COMPRESSED_WIRE }) {
+      std::vector<unsigned char> &out = batch.encodedWire[encoding];
+      if (encoding != PACKED_WIRE && !compress)
+        continue;
+      if (expected)
+        appendWords(expected, 1, out);
+      if (encoding == PACKED_WIRE)
+        out.insert(out.end(), packed.begin(), packed.end());
+      else if (encoding == COMPRESSED_WIRE)
+        appendCompressed(size, problem, size * sizeof(unsigned), out);
+      else
+        appendCompressed(static_cast<unsigned>(packed.size()), packed.data(), packed.size(), out);
+    }
+    problem += size;
+  }
+}
+
+size_t footprintOf(const GeneratedBatch &batch) {
+  size_t bytes = batch.wire.capacity() * sizeof(unsigned);
+  for (auto &encoded : batch.encodedWire)
+    bytes += encoded.capacity();
+  return bytes;
+}
+
+ProblemGenerator::ProblemGenerator(unsigned threads, const SamplerConfig &config,
+                                   const boost::optional<unsigned> &seed, bool compress,
+                                   size_t budget)
+    : mCategories(std::vector<double>(config.categoryWeights.begin(),
+                                      config.categoryWeights.end())),
+      mSizes(config), mCompress(compress), mBudget(budget), mQueuedBytes(0), mRunning(true),
+      mMisses(0), mAllocationFailures(0) {
+  for (auto &queue : mQueues)
+    queue.store(nullptr, std::memory_order_relaxed);
+
+  std::random_device rd;
+  for (unsigned i = 0; i < threads; ++i) {
+    // Every thread gets its own stream, reproducible when seeded
+    unsigned threadSeed = seed ? seed.get() * 7919u + i + 1 : rd();
+    mThreads.emplace_back(&ProblemGenerator::run, this, threadSeed);
+  }
+}
+
+ProblemGenerator::~ProblemGenerator() {
+  mRunning.store(false);
+  for (std::thread &thread : mThreads)
+    thread.join();
+
+  for (auto &slot : mQueues) {
+    std::unique_ptr<Queue> queue(slot.load());
+    GeneratedBatch *ready;
+    while (queue && queue->tryPop(ready))
+      delete ready;
+  }
+}
+
+ProblemGenerator::Queue &ProblemGenerator::getQueue(unsigned width) {
+  Queue *queue = mQueues[width].load(std::memory_order_acquire);
+  if (!queue) {
+    queue = new Queue;
+    mQueues[width].store(queue, std::memory_order_release);
+  }
+  return *queue;
+}
+
+std::unique_ptr<GeneratedBatch> ProblemGenerator::take(unsigned width) {
+  Queue &queue = getQueue(width);
+  GeneratedBatch *ready;
+  if (!queue.tryPop(ready)) {
+    mMisses.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  mQueuedBytes.fetch_sub(footprintOf(*ready), std::memory_order_relaxed);
+  return std::unique_ptr<GeneratedBatch>(ready);
+}
+
+void ProblemGenerator::run(unsigned seed) {
+  Engine engine(seed);
+  while (mRunning.load(std::memory_order_relaxed)) {
+    // Top up every width a connection asked for, within the budget
+    bool busy = false;
+    bool starved = false;
+    for (unsigned width = 1; width <= MAX_BATCH_WIDTH; ++width) {
+      Queue *queue = mQueues[width].load(std::memory_order_acquire);
+      if (!queue || queue->size() >= Queue::capacity() ||
+          (queue->size() > 0 && mQueuedBytes.load(std::memory_order_relaxed) >= mBudget))
+        continue;
+
+      std::unique_ptr<GeneratedBatch> batch;
+      try {
+        batch = generateBatch(static_cast<ProblemType>(mCategories.sample(engine)), width,
+                              engine, mSizes);
+        encodeBatch(*batch, mCompress);
+      } catch (const std::bad_alloc &) {
+        // The queued batches are served meanwhile and free their memory
+        mAllocationFailures.fetch_add(1, std::memory_order_relaxed);
+        starved = true;
+        break;
+      }
+      size_t bytes = footprintOf(*batch);
+      mQueuedBytes.fetch_add(bytes, std::memory_order_relaxed);
+      if (queue->tryPush(batch.get())) {
+        batch.release();
+        busy = true;
+      } else {
+        mQueuedBytes.fetch_sub(bytes, std::memory_order_relaxed);
+      }
+    }
+
+    if (starved)
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    else if (!busy)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
@@ -0,0 +1,131 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include "problems.h"
+#include "protocol.h"
+#include "ring_buffer.h"
+#include "sampler.h"
+
+#include <boost/array.hpp>
+#include <boost/optional.hpp>
+
+#include <atomic>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+// A batch of freshly generated problems, already framed as they go on the
+// wire: [expected value] size data... for each problem, every element
+// widened to 32 bits
+struct GeneratedBatch {
+  ProblemType type;
+  unsigned width;
+  std::vector<unsigned> wire;
+  // The same problems in the other encodings, see WireEncoding. The
+  // compressed ones are only there when the generator compresses.
+  boost::array<std::vector<unsigned char>, NB_WIRE_ENCODINGS> encodedWire;
+  // Answers, as a bitmap
+  std::vector<uint32_t> answers;
+  size_t elements;
+};
+
+// Element counts of generated problems. A category given size weights, as
+// with --sizes, draws a size class with them and then a count evenly within
+// the class, "more" standing for 1M to 4M elements; the other categories
+// keep the sizes the generator always made.
+class ProblemSizes {
+public:
+  ProblemSizes() {}
+  explicit ProblemSizes(const SamplerConfig &config);
+
+  // 0 when the category keeps its usual sizes
+  template <class Engine> size_t sample(ProblemType type, Engine &engine) const {
+    const AliasTable &classes = mClasses[type];
+    if (classes.empty())
+      return 0;
+    int sizeClass = static_cast<int>(classes.sample(engine));
+    return std::uniform_int_distribution<size_t>(lowerBoundOf(sizeClass),
+                                                 upperBoundOf(sizeClass) - 1)(engine);
+  }
+
+private:
+  static size_t lowerBoundOf(int sizeClass);
+  static size_t upperBoundOf(int sizeClass);
+
+  boost::array<AliasTable, ProblemType::NB_ELEMS> mClasses;
+};
+
+// Generates `width` problems of a category with their answers, about half
+// of them true, about as large as `sizes` says:
+//  - mazes are carved at random, and unsolvable ones have a cell of their
+//    only path walled up
+//  - sudokus are valid grids with shuffled digits, rows and columns, and
+//    invalid ones have two cells of a row swapped
+//  - trees are a subtree next to its mirror image, and asymmetric ones
+//    have a value of the mirror changed
+//  - arrays either hold the expected value or not
+//  - passwords are anagrams of one another with random case, and those
+//    answered true have one letter changed; these are only true in
+//    relation to the rest of the batch
+//  - RLE strings decode to the expected length or not, the expected length
+//    being the same for the whole batch as in the problem sets
+std::unique_ptr<GeneratedBatch> generateBatch(ProblemType type, unsigned width,
+                                              std::default_random_engine &engine,
+                                              const ProblemSizes &sizes);
+
+// Fills the other encodings of the batch from its wire
+void encodeBatch(GeneratedBatch &batch, bool compress);
+
+// Bytes of memory the wire and the encodings of a batch hold
+size_t footprintOf(const GeneratedBatch &batch);
+
+// Keeps ready batches of fresh problems at hand. Generator threads draw the
+// category of each batch with the category weights and top up a queue per
+// batch width in use, so a connection takes a batch without generating it
+// on the io thread, and waits a little for one if the generators fall
+// behind. The queues
+// together hold about `budget` bytes of batches: past it only the empty
+// ones are topped up, one batch per generator thread at most.
+class ProblemGenerator {
+public:
+  ProblemGenerator(unsigned threads, const SamplerConfig &config,
+                   const boost::optional<unsigned> &seed, bool compress, size_t budget);
+  ~ProblemGenerator();
+
+  ProblemGenerator(const ProblemGenerator &) = delete;
+  ProblemGenerator &operator=(const ProblemGenerator &) = delete;
+
+  // A ready batch of `width` problems, null when there is none yet. Only
+  // called from the io thread.
+  std::unique_ptr<GeneratedBatch> take(unsigned width);
+
+  // Times a batch was asked for and none was ready
+  uint64_t getMisses() const { return mMisses.load(std::memory_order_relaxed); }
+
+  // Batches the generator threads ran out of memory for
+  uint64_t getAllocationFailures() const {
+    return mAllocationFailures.load(std::memory_order_relaxed);
+  }
+
+private:
+  typedef RingBuffer<GeneratedBatch *, 64> Queue;
+
+  Queue &getQueue(unsigned width);
+  void run(unsigned seed);
+
+  AliasTable mCategories;
+  ProblemSizes mSizes;
+  bool mCompress;
+  size_t mBudget;
+  // Created on first use, by the io thread
+  boost::array<std::atomic<Queue *>, MAX_BATCH_WIDTH + 1> mQueues;
+  // Footprint of the batches in every queue
+  std::atomic<size_t> mQueuedBytes;
+  std::atomic<bool> mRunning;
+  std::atomic<uint64_t> mMisses;
+  std::atomic<uint64_t> mAllocationFailures;
+  std::vector<std::thread> mThreads;
+};
+
+#endif // GENERATOR_H
@@ -0,0 +1,71 @@
+#include "handlers.h"
+
+thread_local std::random_device rd;
+thread_local std::default_random_engine e1(rd());
+std::bernoulli_distribution uniform_dist(0.5);
+
+Answers handleMazeProblem(const Problems<unsigned>& mazes)
+{
+    Answers answer_buf(mazes.size());
+
+    // Generate random answer
+    for (size_t i = 0; i < mazes.size(); ++i)
+        answer_buf[i] = uniform_dist(e1);
+
+    return answer_buf;
+}
+
+Answers handleSudokuProblem(const Problems<unsigned>& sudokus)
+{
+    Answers answer_buf(sudokus.size());
+
+    // Generate random answer
+    for (size_t i = 0; i < sudokus.size(); ++i)
+        answer_buf[i] = uniform_dist(e1);
+
+    return answer_buf;
+}
+
+Answers handleTreeProblem(const Problems<unsigned>& trees)
+{
+    Answers answer_buf(trees.size());
+
+    // Generate random answer
+    for (size_t i = 0; i < trees.size(); ++i)
+        answer_buf[i] = uniform_dist(e1);
+
+    return answer_buf;
+}
+
+Answers handleArrayProblem(const Problems<unsigned>& arrays, const std::vector<unsigned>& expectedValues)
+{
+    Answers answer_buf(arrays.size());
+
+    // Generate random answer
+    for (size_t i = 0; i < arrays.size(); ++i)
+        answer_buf[i] = uniform_dist(e1);
+
+    return answer_buf;
+}
+
+Answers handlePasswordProblem(const Problems<char>& passwords)
+{
+    Answers answer_buf(passwords.size());
+
+    // Generate random answer
+    for (size_t i = 0; i < passwords.size(); ++i)
+        answer_buf[i] = uniform_dist(e1);
+
+    return answer_buf;
+}
+
+Answers handleRLEProblem(const Problems<char>& rles, const std::vector<unsigned>& expectedValues)
+{
+    Answers answer_buf(rles.size());
+
+    // Generate random answer
+    for (size_t i = 0; i < rles.size(); ++i)
+        answer_buf[i] = uniform_dist(e1);
+
+    return answer_buf;
+}
@@ -0,0 +1,26 @@
+#ifndef HANDLERS_H
+#define HANDLERS_H
+
+#include <random>
+#include <vector>
+
+// The solvers of the client, one per category. Each gets the problems of a
+// batch and answers them in order. The client calls them for every batch
+// it reads, and SolverBench times them offline over the problem sets.
+
+template <class T>
+using Problems = std::vector<std::vector<T>>;
+typedef std::vector<bool> Answers;
+
+// Solved from several threads when pipelined, so every thread has its own
+extern thread_local std::default_random_engine e1;
+extern std::bernoulli_distribution uniform_dist;
+
+Answers handleMazeProblem(const Problems<unsigned>& mazes);
+Answers handleSudokuProblem(const Problems<unsigned>& sudokus);
+Answers handleTreeProblem(const Problems<unsigned>& trees);
+Answers handleArrayProblem(const Problems<unsigned>& arrays, const std::vector<unsigned>& expectedValues);
+Answers handlePasswordProblem(const Problems<char>& passwords);
+Answers handleRLEProblem(const Problems<char>& rles, const std::vector<unsigned>& expectedValues);
+
+#endif // HANDLERS_H
@@ -0,0 +1,166 @@
+#include "histogram.h"
+
+#include <algorithm>
+#include <iomanip>
+
+LatencyHistogram::LatencyHistogram() : mCount(0), mMax(0) {
+  for (auto &count : mCounts)
+    count.store(0, std::memory_order_relaxed);
+}
+
+int LatencyHistogram::bucketOf(uint64_t value) {
+  if (value < SUB_BUCKETS)
+    return static_cast<int>(value);
+
+  int msb = 63 - __builtin_clzll(value);
+  int shift = msb - SUB_BUCKET_BITS;
+  int sub = static_cast<int>(value >> shift) - SUB_BUCKETS;
+  return (shift + 1) * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::upperBoundOf(int bucket) {
+  if (bucket < SUB_BUCKETS)
+    return bucket;
+
+  int shift = bucket / SUB_BUCKETS - 1;
+  uint64_t sub = bucket % SUB_BUCKETS + SUB_BUCKETS;
+  return ((sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t value) {
+  mCounts[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+  mCount.fetch_add(1, std::memory_order_relaxed);
+  raiseMax(value);
+}
+
+void LatencyHistogram::raiseMax(uint64_t value) {
+  uint64_t max = mMax.load(std::memory_order_relaxed);
+  while (value > max &&
+         !mMax.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+  }
+}
+
+void LatencyHistogram::add(const LatencyHistogram &other) {
+  for (int bucket = 0; bucket < NB_BUCKETS; ++bucket)
+    mCounts[bucket].fetch_add(other.mCounts[bucket].load(std::memory_order_relaxed),
+                              std::memory_order_relaxed);
+  mCount.fetch_add(other.count(), std::memory_order_relaxed);
+  raiseMax(other.max());
+}
+
+void LatencyHistogram::assign(const LatencyHistogram &other) {
+  for (int bucket = 0; bucket < NB_BUCKETS; ++bucket)
+    mCounts[bucket].store(other.mCounts[bucket].load(std::memory_order_relaxed),
+                          std::memory_order_relaxed);
+  mCount.store(other.count(), std::memory_order_relaxed);
+  mMax.store(other.max(), std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::percentile(double percent) const {
+  uint64_t total = count();
+  if (total == 0)
+    return 0;
+
+  uint64_t wanted = static_cast<uint64_t>(total * percent / 100. + 0.5);
+  if (wanted == 0)
+    wanted = 1;
+
+  uint64_t seen = 0;
+  for (int bucket = 0; bucket < NB_BUCKETS; ++bucket) {
+    seen += mCounts[bucket].load(std::memory_order_relaxed);
+    if (seen >= wanted)
+      return std::min(upperBoundOf(bucket), max());
+  }
+  return max();
+}
+
+LatencyTable::LatencyTable() {
+  for (auto &timeouts : mTimeouts)
+    for (auto &count : timeouts)
+      count.store(0, std::memory_order_relaxed);
+}
+
+void LatencyTable::add(const LatencyTable &other) {
+  for (int type = 0; type < ProblemType::NB_ELEMS; ++type) {
+    for (int bucket = 0; bucket < NB_SIZE_BUCKETS; ++bucket) {
+      mHistograms[type][bucket].add(other.mHistograms[type][bucket]);
+      mTimeouts[type][bucket].fetch_add(other.getTimeouts(static_cast<ProblemType>(type), bucket),
+                                        std::memory_order_relaxed);
+    }
+    mDeadlineUse[type].add(other.mDeadlineUse[type]);
+  }
+}
+
+void LatencyTable::assign(const LatencyTable &other) {
+  for (int type = 0; type < ProblemType::NB_ELEMS; ++type) {
+    for (int bucket = 0; bucket < NB_SIZE_BUCKETS; ++bucket) {
+      mHistograms[type][bucket].assign(other.mHistograms[type][bucket]);
+      mTimeouts[type][bucket].store(other.getTimeouts(static_cast<ProblemType>(type), bucket),
+                                    std::memory_order_relaxed);
+    }
+    mDeadlineUse[type].assign(other.mDeadlineUse[type]);
+  }
+}
+
+int LatencyTable::sizeBucketOf(size_t elements) {
+  int bucket = 0;
+  for (elements >>= 10; elements > 0 && bucket < NB_SIZE_BUCKETS - 1; elements >>= 2)
+    ++bucket;
+  return bucket;
+}
+
+static const char *sizeBucketNames[LatencyTable::NB_SIZE_BUCKETS] = {
+  "<1K", "<4K", "<16K", "<64K", "<256K", "<1M", "<4M", ">=4M"
+};
+
+const char *LatencyTable::getSizeBucketName(int bucket) {
+  return sizeBucketNames[bucket];
+}
+
+void LatencyTable::print(std::ostream &out) const {
+  auto ms = [](uint64_t ns) { return ns / 1e6; };
+
+  out << "Round trips, write completed -> answer received (ms)" << std::endl
+      << std::left << std::setw(10) << "category" << std::setw(9) << "elements"
+      << std::right << std::setw(9) << "answers" << std::setw(9) << "timeouts"
+      << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10)
+      << "p99" << std::setw(10) << "max" << std::endl
+      << std::fixed << std::setprecision(2);
+
+  for (int type = 0; type < ProblemType::NB_ELEMS; ++type) {
+    for (int bucket = 0; bucket < NB_SIZE_BUCKETS; ++bucket) {
+      auto &histogram = mHistograms[type][bucket];
+      uint64_t timeouts = mTimeouts[type][bucket].load(std::memory_order_relaxed);
+      if (histogram.count() == 0 && timeouts == 0)
+        continue;
+
+      out << std::left << std::setw(10) << getProblemTypeName(static_cast<ProblemType>(type))
+          << std::setw(9) << sizeBucketNames[bucket] << std::right
+          << std::setw(9) << histogram.count() << std::setw(9) << timeouts
+          << std::setw(10) << ms(histogram.percentile(50))
+          << std::setw(10) << ms(histogram.percentile(90))
+          << std::setw(10) << ms(histogram.percentile(99))
+          << std::setw(10) << ms(histogram.max()) << std::endl;
+    }
+  }
+
+  auto percent = [](uint64_t permille) { return permille / 10.; };
+
+  out << "Deadline used by the answers (%)" << std::endl
+      << std::left << std::setw(19) << "category" << std::right << std::setw(9)
+      << "answers" << std::setw(19) << "p50" << std::setw(10) << "p90"
+      << std::setw(10) << "p99" << std::setw(10) << "max" << std::endl
+      << std::setprecision(1);
+  for (int type = 0; type < ProblemType::NB_ELEMS; ++type) {
+    auto &histogram = mDeadlineUse[type];
+    if (histogram.count() == 0)
+      continue;
+
+    out << std::left << std::setw(19) << getProblemTypeName(static_cast<ProblemType>(type))
+        << std::right << std::setw(9) << histogram.count()
+        << std::setw(19) << percent(histogram.percentile(50))
+        << std::setw(10) << percent(histogram.percentile(90))
+        << std::setw(10) << percent(histogram.percentile(99))
+        << std::setw(10) << percent(histogram.max()) << std::endl;
+  }
+}
@@ -0,0 +1,98 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include "problems.h"
+
+#include <boost/array.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+// Log-linear histogram in the spirit of HdrHistogram: values below 32 get
+// a bucket each, every power of two above is split in 32 buckets, which
+// keeps any recorded value within ~3% of its bucket. Recording is a couple
+// of relaxed atomic increments, so it is safe from any thread.
+class LatencyHistogram {
+public:
+  static const int SUB_BUCKET_BITS = 5;
+  static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+  static const int NB_BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+  LatencyHistogram();
+
+  void record(uint64_t value);
+
+  // Adds the values recorded by another histogram, or replaces the values
+  // of this one with them
+  void add(const LatencyHistogram &other);
+  void assign(const LatencyHistogram &other);
+
+  uint64_t count() const { return mCount.load(std::memory_order_relaxed); }
+  uint64_t max() const { return mMax.load(std::memory_order_relaxed); }
+
+  // Smallest bucket bound under which at least `percent`% of the values fall
+  uint64_t percentile(double percent) const;
+
+private:
+  static int bucketOf(uint64_t value);
+  static uint64_t upperBoundOf(int bucket);
+  void raiseMax(uint64_t value);
+
+private:
+  boost::array<std::atomic<uint64_t>, NB_BUCKETS> mCounts;
+  std::atomic<uint64_t> mCount;
+  std::atomic<uint64_t> mMax;
+};
+
+// Round-trip latencies of the batches, by category and by the number of
+// elements in the batch (powers of 4, from under 1K elements to 4M and
+// more), and how close to their deadline the answers came by category.
+class LatencyTable {
+public:
+  static const int NB_SIZE_BUCKETS = 8;
+
+  LatencyTable();
+
+  void record(ProblemType type, size_t elements, uint64_t nanoseconds) {
+    mHistograms[type][sizeBucketOf(elements)].record(nanoseconds);
+  }
+
+  void recordTimeout(ProblemType type, size_t elements) {
+    mTimeouts[type][sizeBucketOf(elements)].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // How much of its deadline an answered batch took, in thousandths
+  void recordDeadlineUse(ProblemType type, uint64_t permille) {
+    mDeadlineUse[type].record(permille);
+  }
+
+  // Same as for the histograms, table by table, so that tables kept apart
+  // can be reported as one
+  void add(const LatencyTable &other);
+  void assign(const LatencyTable &other);
+
+  // Writes p50/p90/p99/max, in milliseconds, of every non-empty bucket,
+  // then the same in percent of the deadline for every category
+  void print(std::ostream &out) const;
+
+  const LatencyHistogram &getHistogram(ProblemType type, int bucket) const {
+    return mHistograms[type][bucket];
+  }
+  uint64_t getTimeouts(ProblemType type, int bucket) const {
+    return mTimeouts[type][bucket].load(std::memory_order_relaxed);
+  }
+  const LatencyHistogram &getDeadlineUse(ProblemType type) const {
+    return mDeadlineUse[type];
+  }
+
+  static int sizeBucketOf(size_t elements);
+  static const char *getSizeBucketName(int bucket);
+
+private:
+  boost::array<boost::array<LatencyHistogram, NB_SIZE_BUCKETS>, ProblemType::NB_ELEMS> mHistograms;
+  boost::array<boost::array<std::atomic<uint64_t>, NB_SIZE_BUCKETS>, ProblemType::NB_ELEMS> mTimeouts;
+  boost::array<LatencyHistogram, ProblemType::NB_ELEMS> mDeadlineUse;
+};
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,99 @@
+#include "logger.h"
+
+#include <iomanip>
+#include <iostream>
+
+Logger logger;
+
+static const char *levelNames[] = { "debug", "info", "warn", "error" };
+
+bool parseLogLevel(const std::string &name, LogLevel &level) {
+  for (int i = LOG_DEBUG; i <= LOG_ERROR; ++i) {
+    if (name == levelNames[i]) {
+      level = static_cast<LogLevel>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+Logger::Logger()
+    : mLevel(LOG_INFO), mStart(std::chrono::steady_clock::now()),
+      mSampleTick(0), mSampled(0), mDropped(0), mRunning(false) {}
+
+void Logger::start(LogLevel level) {
+  mLevel = level;
+  mRunning = true;
+  mFlusher = std::thread(&Logger::flush, this);
+}
+
+void Logger::stop() {
+  if (!mRunning.exchange(false))
+    return;
+  mFlusher.join();
+}
+
+void Logger::submit(const LogEntry &entry) {
+  if (entry.level < LOG_WARN && mRing.size() > mRing.capacity() / 2 &&
+      mSampleTick.fetch_add(1, std::memory_order_relaxed) % 16 != 0) {
+    mSampled.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  if (!mRunning.load(std::memory_order_relaxed) || !mRing.tryPush(entry))
+    mDropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Logger::flush() {
+  LogEntry entry;
+  for (;;) {
+    bool running = mRunning.load();
+    bool wrote = false;
+    while (mRing.tryPop(entry)) {
+      write(entry);
+      wrote = true;
+    }
+
+    uint64_t sampled = mSampled.exchange(0, std::memory_order_relaxed);
+    uint64_t dropped = mDropped.exchange(0, std::memory_order_relaxed);
+    if (sampled || dropped)
+      std::cout << "(logger: " << sampled << " lines sampled out, " << dropped
+                << " dropped)" << '\n';
+
+    if (wrote || sampled || dropped)
+      std::cout.flush();
+    else if (!running)
+      return;
+    else
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+void Logger::write(const LogEntry &entry) {
+  std::cout << std::fixed << std::setprecision(3) << std::setw(10)
+            << entry.time / 1e6 << ' ' << std::left << std::setw(5)
+            << levelNames[entry.level] << std::right;
+  if (entry.connection >= 0)
+    std::cout << " conn=" << entry.connection;
+  if (entry.batch >= 0)
+    std::cout << " batch=" << entry.batch;
+  std::cout << ' ';
+  std::cout.write(entry.text, entry.length);
+  std::cout << '\n';
+}
+
+LogLine::LogLine(LogLevel level, int connection, int batch)
+    : mEnabled(logger.isEnabled(level)),
+      mBuf(mEntry.text, LogEntry::TEXT_SIZE), mStream(&mBuf) {
+  mEntry.level = level;
+  mEntry.connection = connection;
+  mEntry.batch = batch;
+}
+
+LogLine::~LogLine() {
+  if (!mEnabled)
+    return;
+  mEntry.time = logger.now();
+  mEntry.length = static_cast<uint16_t>(mBuf.size());
+  logger.submit(mEntry);
+}
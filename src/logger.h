@@ -0,0 +1,114 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include "ring_buffer.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+
+enum LogLevel {
+  LOG_DEBUG,
+  LOG_INFO,
+  LOG_WARN,
+  LOG_ERROR
+};
+
+bool parseLogLevel(const std::string &name, LogLevel &level);
+
+// A formatted line waiting to be written, with the connection and batch it
+// is about (-1 when it is about neither)
+struct LogEntry {
+  static const size_t TEXT_SIZE = 160;
+
+  uint64_t time;
+  LogLevel level;
+  int connection;
+  int batch;
+  uint16_t length;
+  char text[TEXT_SIZE];
+};
+
+// Writes log lines from a background thread. Producers format their line
+// on their own stack and hand it over through a lock-free ring, so logging
+// never blocks the event loop: when the ring is more than half full only
+// one in 16 debug and info lines is kept, and when it is full lines are
+// dropped. Both are counted and reported.
+class Logger {
+public:
+  Logger();
+
+  void start(LogLevel level);
+  // Writes what is left in the ring and joins the flusher
+  void stop();
+
+  bool isEnabled(LogLevel level) const { return level >= mLevel; }
+  uint64_t now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - mStart).count();
+  }
+
+  void submit(const LogEntry &entry);
+
+private:
+  void flush();
+  void write(const LogEntry &entry);
+
+private:
+  LogLevel mLevel;
+  std::chrono::steady_clock::time_point mStart;
+  RingBuffer<LogEntry, 4096> mRing;
+  std::atomic<uint64_t> mSampleTick;
+  std::atomic<uint64_t> mSampled;
+  std::atomic<uint64_t> mDropped;
+  std::atomic<bool> mRunning;
+  std::thread mFlusher;
+};
+
+extern Logger logger;
+
+// Streambuf over a fixed array, anything past its end is cut off
+class ArrayStreamBuf : public std::streambuf {
+public:
+  ArrayStreamBuf(char *buffer, size_t size) { setp(buffer, buffer + size); }
+  size_t size() const { return pptr() - pbase(); }
+};
+
+// One log line, formatted with << and submitted when it goes out of scope.
+// Lines are written through LOG_LINE, which checks the level first so a
+// disabled line builds no stream and evaluates none of its operands.
+class LogLine {
+public:
+  LogLine(LogLevel level, int connection = -1, int batch = -1);
+  ~LogLine();
+
+  template <class T> LogLine &operator<<(const T &value) {
+    if (mEnabled)
+      mStream << value;
+    return *this;
+  }
+
+private:
+  LogLine(const LogLine &) = delete;
+  LogLine &operator=(const LogLine &) = delete;
+
+private:
+  bool mEnabled;
+  LogEntry mEntry;
+  ArrayStreamBuf mBuf;
+  std::ostream mStream;
+};
+
+inline LogLevel logLevelOf(LogLevel level, int = -1, int = -1) { return level; }
+
+//   LOG_LINE(LOG_INFO, mId, mBatchSerial) << "well alright... +" << points;
+#define LOG_LINE(...)                                                          \
+  for (bool logLineEnabled = logger.isEnabled(logLevelOf(__VA_ARGS__));        \
+       logLineEnabled; logLineEnabled = false)                                 \
+    LogLine(__VA_ARGS__)
+
+#endif // LOGGER_H
@@ -0,0 +1,154 @@
+#include "lz.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+const size_t MIN_MATCH = 4;
+const size_t MAX_DISTANCE = 0xFFFF;
+// Blocks end with literals, so matches are only looked for this far from
+// the end
+const size_t LAST_LITERALS = 5;
+const size_t MATCH_SEARCH_LIMIT = 12;
+const unsigned HASH_BITS = 12;
+
+uint32_t read32(const unsigned char *p) {
+  uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+unsigned hash(uint32_t sequence) {
+  return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+void writeLength(size_t length, std::vector<unsigned char> &out) {
+  for (; length >= 255; length -= 255)
+    out.push_back(255);
+  out.push_back(static_cast<unsigned char>(length));
+}
+
+void writeSequence(const unsigned char *literals, size_t literalCount,
+                   size_t distance, size_t matchLength,
+                   std::vector<unsigned char> &out) {
+  size_t matchCode = matchLength ? matchLength - MIN_MATCH : 0;
+  out.push_back(static_cast<unsigned char>(
+      (literalCount < 15 ? literalCount : 15) << 4 | (matchCode < 15 ? matchCode : 15)));
+  if (literalCount >= 15)
+    writeLength(literalCount - 15, out);
+  out.insert(out.end(), literals, literals + literalCount);
+
+  if (matchLength) {
+    out.push_back(static_cast<unsigned char>(distance));
+    out.push_back(static_cast<unsigned char>(distance >> 8));
+    if (matchCode >= 15)
+      writeLength(matchCode - 15, out);
+  }
+}
+
+// Reads the rest of a length given as 15 in a token
+bool readLength(const unsigned char *&in, const unsigned char *end, size_t &length) {
+  unsigned char byte;
+  do {
+    if (in == end)
+      return false;
+    byte = *in++;
+    length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+} // namespace
+
+size_t lzCompress(const void *data, size_t size, std::vector<unsigned char> &out) {
+  const unsigned char *in = static_cast<const unsigned char *>(data);
+  const unsigned char *end = in + size;
+  const unsigned char *anchor = in;
+  size_t start = out.size();
+
+  if (size > MATCH_SEARCH_LIMIT) {
+    // Last position of each hashed 4-byte sequence, plus one so 0 is empty
+    std::vector<uint32_t> table(1 << HASH_BITS, 0);
+    const unsigned char *searchEnd = end - MATCH_SEARCH_LIMIT;
+    const unsigned char *matchEnd = end - LAST_LITERALS;
+
+    for (const unsigned char *ip = in; ip < searchEnd;) {
+      uint32_t sequence = read32(ip);
+      uint32_t &slot = table[hash(sequence)];
+      const unsigned char *candidate = slot ? in + slot - 1 : nullptr;
+      slot = static_cast<uint32_t>(ip - in + 1);
+
+      if (!candidate || static_cast<size_t>(ip - candidate) > MAX_DISTANCE ||
+          read32(candidate) != sequence) {
+        ++ip;
+        continue;
+      }
+
+      const unsigned char *match = ip + MIN_MATCH;
+      const unsigned char *reference = candidate + MIN_MATCH;
+      while (match < matchEnd && *match == *reference) {
+        ++match;
+        ++reference;
+      }
+
+      writeSequence(anchor, ip - anchor, ip - candidate, match - ip, out);
+      ip = anchor = match;
+    }
+  }
+
+  writeSequence(anchor, end - anchor, 0, 0, out);
+  return out.size() - start;
+}
+
+bool lzDecompress(const void *data, size_t compressedSize, void *out, size_t size) {
+  const unsigned char *in = static_cast<const unsigned char *>(data);
+  const unsigned char *inEnd = in + compressedSize;
+  unsigned char *begin = static_cast<unsigned char *>(out);
+  unsigned char *op = begin;
+  unsigned char *outEnd = begin + size;
+
+  while (in < inEnd) {
+    unsigned token = *in++;
+
+    size_t literalCount = token >> 4;
+    if (literalCount == 15 && !readLength(in, inEnd, literalCount))
+      return false;
+    if (literalCount > static_cast<size_t>(inEnd - in) ||
+        literalCount > static_cast<size_t>(outEnd - op))
+      return false;
+    if (literalCount)
+      std::memcpy(op, in, literalCount);
+    op += literalCount;
+    in += literalCount;
+
+    // Only the last sequence has no match
+    if (in == inEnd)
+      break;
+
+    if (inEnd - in < 2)
+      return false;
+    size_t distance = in[0] | in[1] << 8;
+    in += 2;
+    size_t matchLength = token & 15;
+    if (matchLength == 15 && !readLength(in, inEnd, matchLength))
+      return false;
+    matchLength += MIN_MATCH;
+    if (distance == 0 || distance > static_cast<size_t>(op - begin) ||
+        matchLength > static_cast<size_t>(outEnd - op))
+      return false;
+
+    // Matches may overlap what they copy, as runs do: copy them a distance
+    // at a time, the repeating pattern doubling with every copy
+    const unsigned char *match = op - distance;
+    for (size_t left = matchLength; left > 0;) {
+      size_t chunk = std::min<size_t>(left, op - match);
+      std::memcpy(op, match, chunk);
+      op += chunk;
+      left -= chunk;
+    }
+  }
+
+  return op == outEnd;
+}
@@ -0,0 +1,22 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <cstddef>
+#include <vector>
+
+// Byte-oriented LZ77 block codec in the spirit of LZ4, fast to decode and
+// with no dependency, shared by the server and the client. A block is a
+// series of sequences, each a token byte holding the literal count in its
+// high nibble and the match length minus 4 in its low one (15 meaning more
+// length bytes follow, each adding up to 255), the literals, then the
+// 16-bit little-endian distance back to the match. The last sequence has
+// literals only.
+
+// Appends the compressed image of `size` bytes to `out` and returns its size
+size_t lzCompress(const void *data, size_t size, std::vector<unsigned char> &out);
+
+// Decodes a block into exactly `size` bytes, false if it does not decode
+// to that
+bool lzDecompress(const void *data, size_t compressedSize, void *out, size_t size);
+
+#endif // LZ_H
@@ -0,0 +1,96 @@
+#include "packing.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+void appendWord(unsigned word, std::vector<unsigned char> &out) {
+  unsigned char bytes[sizeof(word)];
+  std::memcpy(bytes, &word, sizeof(word));
+  out.insert(out.end(), bytes, bytes + sizeof(word));
+}
+
+} // namespace
+
+void packString(const unsigned *data, size_t size, std::vector<unsigned char> &out) {
+  appendWord(static_cast<unsigned>(size), out);
+  // Characters were widened from char, only their low byte matters
+  for (size_t i = 0; i < size; ++i)
+    out.push_back(static_cast<unsigned char>(data[i]));
+}
+
+void packMaze(const unsigned *data, size_t size, std::vector<unsigned char> &out) {
+  unsigned side = static_cast<unsigned>(std::lround(std::sqrt(static_cast<double>(size))));
+  bool binary = static_cast<size_t>(side) * side == size;
+  for (size_t i = 0; binary && i < size; ++i)
+    binary = data[i] <= 1;
+  if (!binary || size == 0) {
+    appendWord(0, out);
+    packElements(data, size, out);
+    return;
+  }
+
+  appendWord(side, out);
+  appendWord(side, out);
+  size_t rowBytes = packedRowBytes(side);
+  for (unsigned row = 0; row < side; ++row) {
+    size_t start = out.size();
+    out.resize(start + rowBytes, 0);
+    const unsigned *cells = data + static_cast<size_t>(row) * side;
+    for (unsigned col = 0; col < side; ++col)
+      out[start + col / 8] |= static_cast<unsigned char>(cells[col] << (col % 8));
+  }
+}
+
+void packElements(const unsigned *data, size_t size, std::vector<unsigned char> &out) {
+  // The narrowest width every element fits in, as a signed value
+  unsigned elementBytes = 1;
+  for (size_t i = 0; i < size; ++i) {
+    int32_t value = static_cast<int32_t>(data[i]);
+    if (value < INT16_MIN || value > INT16_MAX) {
+      elementBytes = 4;
+      break;
+    }
+    if (value < INT8_MIN || value > INT8_MAX)
+      elementBytes = 2;
+  }
+
+  appendWord(static_cast<unsigned>(size), out);
+  out.push_back(static_cast<unsigned char>(elementBytes));
+  size_t start = out.size();
+  out.resize(start + size * elementBytes);
+  for (size_t i = 0; i < size; ++i)
+    for (unsigned b = 0; b < elementBytes; ++b)
+      out[start + i * elementBytes + b] = static_cast<unsigned char>(data[i] >> (8 * b));
+}
+
+void unpackString(const unsigned char *in, size_t size, unsigned *out) {
+  for (size_t i = 0; i < size; ++i)
+    out[i] = static_cast<unsigned>(static_cast<int>(static_cast<signed char>(in[i])));
+}
+
+void unpackMaze(const unsigned char *in, unsigned width, unsigned height, unsigned *out) {
+  size_t rowBytes = packedRowBytes(width);
+  for (unsigned row = 0; row < height; ++row, in += rowBytes)
+    for (unsigned col = 0; col < width; ++col)
+      *out++ = (in[col / 8] >> (col % 8)) & 1;
+}
+
+void unpackElements(const unsigned char *in, size_t size, unsigned elementBytes, unsigned *out) {
+  for (size_t i = 0; i < size; ++i, in += elementBytes) {
+    switch (elementBytes) {
+    case 1:
+      out[i] = static_cast<unsigned>(static_cast<int32_t>(static_cast<int8_t>(in[0])));
+      break;
+    case 2:
+      out[i] = static_cast<unsigned>(static_cast<int32_t>(
+          static_cast<int16_t>(in[0] | in[1] << 8)));
+      break;
+    default:
+      std::memcpy(&out[i], in, sizeof(unsigned));
+      break;
+    }
+  }
+}
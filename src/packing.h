@@ -0,0 +1,30 @@
+#ifndef PACKING_H
+#define PACKING_H
+
+#include <cstddef>
+#include <vector>
+
+// Payload encodings of protocol v2, shared by the server and the client.
+// Payloads are otherwise sent as one u32 per element; in v2 they go as
+//
+//   strings  u32 size, size bytes
+//   mazes    u32 width, u32 height, height rows of packedRowBytes(width)
+//            bytes, cell j of a row in bit j % 8 of byte j / 8
+//   others   u32 size, u8 element bytes (1, 2 or 4), size little-endian
+//            signed elements of that many bytes
+//
+// A maze that is not a square of 0s and 1s is sent with a width of 0,
+// then as the others.
+
+inline size_t packedRowBytes(unsigned width) { return (width + 7) / 8; }
+
+void packString(const unsigned *data, size_t size, std::vector<unsigned char> &out);
+void packMaze(const unsigned *data, size_t size, std::vector<unsigned char> &out);
+void packElements(const unsigned *data, size_t size, std::vector<unsigned char> &out);
+
+// Widen packed payloads back to one u32 per element, as in protocol v1
+void unpackString(const unsigned char *in, size_t size, unsigned *out);
+void unpackMaze(const unsigned char *in, unsigned width, unsigned height, unsigned *out);
+void unpackElements(const unsigned char *in, size_t size, unsigned elementBytes, unsigned *out);
+
+#endif // PACKING_H
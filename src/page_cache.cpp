@@ -0,0 +1,244 @@
+#include "page_cache.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Reads as much of `bytes` as the file holds from `offset`, -1 on error
+static ssize_t readFully(int fd, uint64_t offset, void *out, size_t bytes) {
+  size_t done = 0;
+  while (done < bytes) {
+    ssize_t got = ::pread(fd, static_cast<char *>(out) + done, bytes - done, offset + done);
+    if (got < 0 && errno == EINTR)
+      continue;
+    if (got < 0)
+      return -1;
+    if (got == 0)
+      break;
+    done += got;
+  }
+  return static_cast<ssize_t>(done);
+}
+
+PagedFile::~PagedFile() {
+  mCache->forget(mId);
+  ::close(mFd);
+}
+
+bool PagedFile::read(uint64_t offset, void *out, size_t bytes) const {
+  return readFully(mFd, offset, out, bytes) == static_cast<ssize_t>(bytes);
+}
+
+const char *PagedFile::pin(uint64_t page, uint32_t &slot) {
+  return mCache->pin(*this, page, slot);
+}
+
+void PagedFile::prefetch(uint64_t offset, size_t bytes) {
+  mCache->prefetch(*this, offset, bytes);
+}
+
+std::shared_ptr<PageCache> PageCache::create(size_t bytes) {
+  return std::shared_ptr<PageCache>(new PageCache(std::max<size_t>(1, bytes / PAGE_SIZE)));
+}
+
+PageCache::PageCache(size_t pages)
+    : mCapacity(pages), mPool(new char[pages * PAGE_SIZE]), mSlots(pages), mNextFile(1),
+      mHits(0), mFaults(0), mPrefetched(0), mOverBound(0), mReadErrors(0) {
+  mPages.reserve(pages);
+  for (uint32_t i = 0; i < pages; ++i) {
+    Slot &slot = mSlots[i];
+    slot.key = NO_PAGE;
+    slot.pins = 0;
+    slot.loading = false;
+    slot.data = &mPool[i * PAGE_SIZE];
+    slot.position = mUnpinned.insert(mUnpinned.end(), i);
+  }
+}
+
+std::shared_ptr<PagedFile> PageCache::open(const std::string &name) {
+  int fd = ::open(name.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return nullptr;
+  struct stat info;
+  if (::fstat(fd, &info) != 0) {
+    ::close(fd);
+    return nullptr;
+  }
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  return std::shared_ptr<PagedFile>(
+      new PagedFile(shared_from_this(), fd, mNextFile++, static_cast<uint64_t>(info.st_size)));
+}
+
+const char *PageCache::pin(const PagedFile &file, uint64_t page, uint32_t &slot) {
+  std::unique_lock<std::mutex> lock(mMutex);
+  uint64_t key = keyOf(file.mId, page);
+  auto cached = mPages.find(key);
+  if (cached != mPages.end()) {
+    slot = cached->second;
+    Slot &hit = mSlots[slot];
+    if (hit.pins++ == 0)
+      mPinned.splice(mPinned.end(), mUnpinned, hit.position);
+    mHits.fetch_add(1, std::memory_order_relaxed);
+    // Slots may move while waiting, as more go over the bound. A page that
+    // could not be read leaves the cache.
+    uint32_t index = slot;
+    mLoaded.wait(lock, [&]() { return !mSlots[index].loading; });
+    if (mSlots[index].key != key) {
+      unpinLocked(index);
+      return nullptr;
+    }
+    return mSlots[index].data;
+  }
+
+  // Evict the least recently used page, or go over the bound if they are
+  // all pinned
+  auto start = std::chrono::steady_clock::now();
+  if (!mUnpinned.empty()) {
+    slot = mUnpinned.back();
+    Slot &evicted = mSlots[slot];
+    if (evicted.key != NO_PAGE)
+      mPages.erase(evicted.key);
+    mPinned.splice(mPinned.end(), mUnpinned, evicted.position);
+    evicted.key = key;
+    mPages.emplace(key, slot);
+  } else {
+    if (mSpareSlots.empty()) {
+      slot = static_cast<uint32_t>(mSlots.size());
+      mSlots.emplace_back();
+    } else {
+      slot = mSpareSlots.back();
+      mSpareSlots.pop_back();
+    }
+    Slot &extra = mSlots[slot];
+    extra.own.reset(new char[PAGE_SIZE]);
+    extra.data = extra.own.get();
+    extra.key = NO_PAGE;
+    mOverBound.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // The slot is pinned, so its memory stays put while the lock is let go
+  uint32_t index = slot;
+  char *data = mSlots[index].data;
+  mSlots[index].pins = 1;
+  mSlots[index].loading = true;
+  lock.unlock();
+  // Only the last page of the file is short, the rest of it is zeros
+  uint64_t first = page * PAGE_SIZE;
+  size_t expected = first < file.mSize ? std::min(uint64_t(PAGE_SIZE), file.mSize - first) : 0;
+  ssize_t got = readFully(file.mFd, first, data, PAGE_SIZE);
+  bool failed = got < static_cast<ssize_t>(expected);
+  if (!failed)
+    std::memset(data + got, 0, PAGE_SIZE - got);
+  lock.lock();
+
+  Slot &fault = mSlots[index];
+  fault.loading = false;
+  mLoaded.notify_all();
+  mFaults.fetch_add(1, std::memory_order_relaxed);
+  mFaultLatency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - start).count());
+  if (failed) {
+    // Not cached, so the next batch tries again
+    mReadErrors.fetch_add(1, std::memory_order_relaxed);
+    if (fault.key != NO_PAGE)
+      mPages.erase(fault.key);
+    fault.key = NO_PAGE;
+    unpinLocked(index);
+    return nullptr;
+  }
+  return data;
+}
+
+void PageCache::unpin(uint32_t slot) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  unpinLocked(slot);
+}
+
+void PageCache::unpinLocked(uint32_t slot) {
+  Slot &unpinned = mSlots[slot];
+  if (--unpinned.pins > 0)
+    return;
+
+  if (slot >= mCapacity) {
+    unpinned.own.reset();
+    unpinned.data = nullptr;
+    mSpareSlots.push_back(slot);
+  } else {
+    // Slots holding nothing are the first to be reused
+    mUnpinned.splice(unpinned.key == NO_PAGE ? mUnpinned.end() : mUnpinned.begin(), mPinned,
+                     unpinned.position);
+  }
+}
+
+void PageCache::prefetch(const PagedFile &file, uint64_t offset, size_t bytes) {
+  if (bytes == 0)
+    return;
+  uint64_t first = offset / PAGE_SIZE;
+  uint64_t last = (offset + bytes - 1) / PAGE_SIZE;
+  uint64_t missing = 0;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (uint64_t page = first; page <= last; ++page)
+      missing += mPages.count(keyOf(file.mId, page)) == 0;
+  }
+  if (missing == 0)
+    return;
+  ::posix_fadvise(file.mFd, first * PAGE_SIZE, (last - first + 1) * PAGE_SIZE,
+                  POSIX_FADV_WILLNEED);
+  mPrefetched.fetch_add(missing, std::memory_order_relaxed);
+}
+
+void PageCache::forget(uint32_t file) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  for (uint32_t i = 0; i < mCapacity; ++i) {
+    Slot &slot = mSlots[i];
+    if (slot.key == NO_PAGE || slot.key >> 40 != file)
+      continue;
+    mPages.erase(slot.key);
+    slot.key = NO_PAGE;
+    if (slot.pins == 0)
+      mUnpinned.splice(mUnpinned.end(), mUnpinned, slot.position);
+  }
+}
+
+size_t PageCache::getResidentBytes() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  size_t overBound = mSlots.size() - mCapacity - mSpareSlots.size();
+  return (mPages.size() + overBound) * PAGE_SIZE;
+}
+
+void PageCache::print(std::ostream &out) const {
+  auto ms = [](uint64_t ns) { return ns / 1e6; };
+  uint64_t hits = mHits.load(std::memory_order_relaxed);
+  uint64_t faults = mFaults.load(std::memory_order_relaxed);
+  out << std::fixed << std::setprecision(1) << "Page cache: "
+      << getResidentBytes() / (1024. * 1024.) << " of " << getCapacity() / (1024. * 1024.)
+      << " MiB resident, " << hits << " hits ("
+      << 100. * hits / std::max<uint64_t>(hits + faults, 1) << "%), " << faults
+      << " faults" << std::setprecision(2) << " (p50 " << ms(mFaultLatency.percentile(50))
+      << ", p99 " << ms(mFaultLatency.percentile(99)) << ", max " << ms(mFaultLatency.max())
+      << " ms), " << mPrefetched.load(std::memory_order_relaxed) << " pages prefetched, "
+      << mOverBound.load(std::memory_order_relaxed) << " pages over the bound, "
+      << mReadErrors.load(std::memory_order_relaxed) << " read errors" << std::endl;
+}
+
+void PageCache::writeJson(std::ostream &out) const {
+  out << "{\"capacity_bytes\":" << getCapacity()
+      << ",\"resident_bytes\":" << getResidentBytes()
+      << ",\"hits\":" << mHits.load(std::memory_order_relaxed)
+      << ",\"faults\":" << mFaults.load(std::memory_order_relaxed)
+      << ",\"fault_latency\":{\"p50\":" << mFaultLatency.percentile(50)
+      << ",\"p90\":" << mFaultLatency.percentile(90)
+      << ",\"p99\":" << mFaultLatency.percentile(99)
+      << ",\"max\":" << mFaultLatency.max() << "}"
+      << ",\"prefetched_pages\":" << mPrefetched.load(std::memory_order_relaxed)
+      << ",\"over_bound_pages\":" << mOverBound.load(std::memory_order_relaxed)
+      << ",\"read_errors\":" << mReadErrors.load(std::memory_order_relaxed) << "}";
+}
@@ -0,0 +1,133 @@
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include "histogram.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class PageCache;
+
+// A file whose pages are read through a page cache. Its pages are dropped
+// from the cache when the last reference to it goes.
+class PagedFile {
+public:
+  ~PagedFile();
+
+  PagedFile(const PagedFile &) = delete;
+  PagedFile &operator=(const PagedFile &) = delete;
+
+  uint64_t size() const { return mSize; }
+
+  // Reads bytes of the file directly, bypassing the cache
+  bool read(uint64_t offset, void *out, size_t bytes) const;
+
+  // The page `page` of the file, which stays in memory until its slot is
+  // unpinned. Null if it could not be read, and then nothing is pinned.
+  const char *pin(uint64_t page, uint32_t &slot);
+
+  // Has the kernel start reading the pages of a range the cache does not
+  // hold yet
+  void prefetch(uint64_t offset, size_t bytes);
+
+private:
+  friend class PageCache;
+
+  PagedFile(std::shared_ptr<PageCache> cache, int fd, uint32_t id, uint64_t size)
+      : mCache(std::move(cache)), mFd(fd), mId(id), mSize(size) {}
+
+  std::shared_ptr<PageCache> mCache;
+  int mFd;
+  uint32_t mId;
+  uint64_t mSize;
+};
+
+// Pages of files read on demand into a fixed pool of memory, the least
+// recently used page making room for the next one, so memory stays the
+// same however large the files are. Pages are pinned while their bytes are
+// referred to, by a batch being written for instance, and only unpinned
+// pages are evicted; when every page is pinned, the page is read into
+// memory of its own, freed once unpinned, and counted as over the bound.
+// Pinning takes a lock, which is let go while a miss is read: the slot is
+// marked as loading meanwhile, and pinning that page again waits for the
+// read rather than starts another, while other pages can still be pinned
+// and unpinned. The thread that faults still waits for its page. Counters
+// can be read from any thread.
+class PageCache : public std::enable_shared_from_this<PageCache> {
+public:
+  static const size_t PAGE_SIZE = 64 * 1024;
+
+  // A cache of `bytes` rounded to whole pages, at least one
+  static std::shared_ptr<PageCache> create(size_t bytes);
+
+  // Null if the file cannot be opened
+  std::shared_ptr<PagedFile> open(const std::string &name);
+
+  void unpin(uint32_t slot);
+
+  size_t getCapacity() const { return mCapacity * PAGE_SIZE; }
+  size_t getResidentBytes() const;
+
+  // One line with the hit rate, the fault latencies and the other counters
+  void print(std::ostream &out) const;
+  void writeJson(std::ostream &out) const;
+
+private:
+  friend class PagedFile;
+
+  explicit PageCache(size_t pages);
+
+  const char *pin(const PagedFile &file, uint64_t page, uint32_t &slot);
+  void prefetch(const PagedFile &file, uint64_t offset, size_t bytes);
+  void forget(uint32_t file);
+  void unpinLocked(uint32_t slot);
+
+  static uint64_t keyOf(uint32_t file, uint64_t page) {
+    return static_cast<uint64_t>(file) << 40 | page;
+  }
+
+  struct Slot {
+    uint64_t key;
+    uint32_t pins;
+    // Being read without the lock held, see pin()
+    bool loading;
+    char *data;
+    // Memory of its own when over the bound, null otherwise
+    std::unique_ptr<char[]> own;
+    std::list<uint32_t>::iterator position;
+  };
+
+  static const uint64_t NO_PAGE = ~0ULL;
+
+  mutable std::mutex mMutex;
+  // Signalled when pages are done loading
+  std::condition_variable mLoaded;
+  size_t mCapacity;
+  std::unique_ptr<char[]> mPool;
+  // Pool slots first, then those over the bound
+  std::vector<Slot> mSlots;
+  std::vector<uint32_t> mSpareSlots;
+  // Unpinned pool slots, most recently used first, then pinned ones
+  std::list<uint32_t> mUnpinned;
+  std::list<uint32_t> mPinned;
+  std::unordered_map<uint64_t, uint32_t> mPages;
+  uint32_t mNextFile;
+
+  std::atomic<uint64_t> mHits;
+  std::atomic<uint64_t> mFaults;
+  std::atomic<uint64_t> mPrefetched;
+  std::atomic<uint64_t> mOverBound;
+  std::atomic<uint64_t> mReadErrors;
+  LatencyHistogram mFaultLatency;
+};
+
+#endif // PAGE_CACHE_H
@@ -0,0 +1,97 @@
+#include "problem_store.h"
+
+#include <algorithm>
+
+// Told apart by a number rather than their address, which a store built
+// after another one is gone may get again
+static std::atomic<uint64_t> nextStoreId(1);
+
+ProblemStore::ProblemStore() : mId(nextStoreId++), mEpoch(0), mCurrent(nullptr) {}
+
+ProblemStore::~ProblemStore() { delete mCurrent.load(); }
+
+ProblemStore::Participant &ProblemStore::local() {
+  thread_local uint64_t owner = 0;
+  thread_local Participant *participant = nullptr;
+  if (owner != mId) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mParticipants.emplace_back(new Participant);
+    participant = mParticipants.back().get();
+    owner = mId;
+  }
+  return *participant;
+}
+
+void ProblemStore::announce(Participant &participant) {
+  auto &pins = participant.pins;
+  while (!pins.empty() && pins.front().second == 0)
+    pins.pop_front();
+  uint64_t oldest = pins.empty() ? NOT_PINNED : pins.front().first;
+  if (participant.oldest.load(std::memory_order_relaxed) != oldest)
+    participant.oldest.store(oldest);
+}
+
+void ProblemStore::addPin(Participant &participant, uint64_t epoch) {
+  auto &pins = participant.pins;
+  if (!pins.empty() && pins.back().first == epoch)
+    ++pins.back().second;
+  else
+    pins.emplace_back(epoch, 1);
+  announce(participant);
+}
+
+void ProblemStore::dropPin(Participant &participant, uint64_t epoch) {
+  for (auto &pin : participant.pins) {
+    if (pin.first == epoch) {
+      --pin.second;
+      break;
+    }
+  }
+  announce(participant);
+}
+
+const ProblemSet *ProblemStore::pin() {
+  Participant &participant = local();
+  for (;;) {
+    // Announce the epoch before looking at the set: either the publisher
+    // sees the pin before reclaiming, or we see its new set and try again
+    uint64_t epoch = mEpoch.load();
+    addPin(participant, epoch);
+
+    ProblemSet *set = mCurrent.load();
+    if (set && set->epoch == epoch)
+      return set;
+    dropPin(participant, epoch);
+    if (!set)
+      return nullptr;
+  }
+}
+
+void ProblemStore::unpin(const ProblemSet *set) {
+  if (set)
+    dropPin(local(), set->epoch);
+}
+
+void ProblemStore::publish(std::unique_ptr<ProblemSet> set) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  uint64_t epoch = mEpoch.load() + 1;
+  set->epoch = epoch;
+  ProblemSet *previous = mCurrent.exchange(set.release());
+  mEpoch.store(epoch);
+  if (previous)
+    mRetired.emplace_back(previous);
+}
+
+size_t ProblemStore::reclaim() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  uint64_t oldest = NOT_PINNED;
+  for (auto &participant : mParticipants)
+    oldest = std::min(oldest, participant->oldest.load());
+
+  mRetired.erase(std::remove_if(mRetired.begin(), mRetired.end(),
+                                [oldest](const std::unique_ptr<ProblemSet> &set) {
+                                  return set->epoch < oldest;
+                                }),
+                 mRetired.end());
+  return mRetired.size();
+}
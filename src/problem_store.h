@@ -0,0 +1,74 @@
+#ifndef PROBLEM_STORE_H
+#define PROBLEM_STORE_H
+
+#include "problems.h"
+#include "sampler.h"
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Everything loaded from one generation of the problem sets
+struct ProblemSet {
+  ProblemContainer problems;
+  ProblemSampler sampler;
+  uint64_t epoch;
+};
+
+// Publishes problem sets so they can be replaced while being served.
+//
+// Readers pin the current set for as long as they refer to it, which for a
+// batch lasts until it is both answered and written. Publishing swaps the
+// current set atomically and retires the old one, which is freed once no
+// thread has anything pinned from its epoch or before (epoch-based
+// reclamation). Each thread keeps its pins in a record of its own and
+// announces the oldest epoch it has pinned, so pinning and unpinning take
+// no lock; only publishing and reclaiming do.
+class ProblemStore {
+public:
+  ProblemStore();
+  ~ProblemStore();
+
+  // The current set, which stays alive until unpinned by the same thread.
+  // Null until a set has been published.
+  const ProblemSet *pin();
+  void unpin(const ProblemSet *set);
+
+  // Makes `set` current and retires the previous one
+  void publish(std::unique_ptr<ProblemSet> set);
+
+  // Frees the retired sets no thread has pinned anymore, returns how many
+  // are still waiting
+  size_t reclaim();
+
+private:
+  struct Participant {
+    Participant() : oldest(NOT_PINNED) {}
+
+    // Oldest epoch the thread has pinned, NOT_PINNED if none
+    std::atomic<uint64_t> oldest;
+    // Pin count per epoch, oldest first; only the thread itself uses it
+    std::deque<std::pair<uint64_t, uint64_t>> pins;
+  };
+
+  static const uint64_t NOT_PINNED = UINT64_MAX;
+
+  Participant &local();
+  static void announce(Participant &participant);
+  static void addPin(Participant &participant, uint64_t epoch);
+  static void dropPin(Participant &participant, uint64_t epoch);
+
+  const uint64_t mId;
+  std::atomic<uint64_t> mEpoch;
+  std::atomic<ProblemSet *> mCurrent;
+
+  std::mutex mMutex;
+  std::vector<std::unique_ptr<Participant>> mParticipants;
+  std::vector<std::unique_ptr<ProblemSet>> mRetired;
+};
+
+#endif // PROBLEM_STORE_H
@@ -0,0 +1,308 @@
+#include "problems.h"
+#include "dataset.h"
+#include "lz.h"
+#include "packing.h"
+#include "page_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_set>
+
+using namespace boost::interprocess;
+
+const char *getProblemTypeName(ProblemType type) {
+  static const char *names[ProblemType::NB_ELEMS] = {
+    "maze", "sudoku", "tree", "array", "password", "RLE"
+  };
+  return names[type];
+}
+
+bool parseProblemType(const std::string &name, ProblemType &type) {
+  for (int i = 0; i < ProblemType::NB_ELEMS; ++i) {
+    if (name == getProblemTypeName(static_cast<ProblemType>(i))) {
+      type = static_cast<ProblemType>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool guessProblemType(const std::string &name, ProblemType &type) {
+  size_t start = name.find_last_of('/');
+  start = start == std::string::npos ? 0 : start + 1;
+  size_t end = name.find_first_of("_.", start);
+  return parseProblemType(name.substr(start, end == std::string::npos ? end : end - start), type);
+}
+
+MappedFile::MappedFile(const std::string &name) {
+  try {
+    mFile = file_mapping(name.c_str(), read_only);
+    mRegion = mapped_region(mFile, read_only);
+  } catch (const interprocess_exception &) {
+    // Nothing to serve from this file
+  }
+}
+
+void packPayload(ProblemType type, const unsigned *data, size_t size,
+                 std::vector<unsigned char> &out) {
+  if (type == PASSWORD || type == RLE)
+    packString(data, size, out);
+  else if (type == MAZE)
+    packMaze(data, size, out);
+  else
+    packElements(data, size, out);
+}
+
+template <class Encode>
+void ProblemArena::encode(EncodedPayloads &encoded, Encode encodePayload) {
+  encoded.bytes.clear();
+  encoded.offsets.clear();
+  encoded.lengths.clear();
+
+  // Shared payloads are encoded once, at their first use
+  std::unordered_map<size_t, std::pair<size_t, unsigned>> images;
+  for (size_t i = 0; i < mOffsets.size(); ++i) {
+    auto inserted = images.emplace(mOffsets[i], std::make_pair(encoded.bytes.size(), 0u));
+    std::pair<size_t, unsigned> &image = inserted.first->second;
+    if (inserted.second) {
+      encodePayload(i, encoded.bytes);
+      image.second = static_cast<unsigned>(encoded.bytes.size() - image.first);
+    }
+    encoded.offsets.push_back(image.first);
+    encoded.lengths.push_back(image.second);
+  }
+  encoded.bytes.shrink_to_fit();
+}
+
+void ProblemArena::pack(ProblemType type) {
+  EncodedPayloads &packed = mEncoded[PACKED_WIRE];
+  encode(packed, [&](size_t index, std::vector<unsigned char> &out) {
+    packPayload(type, &mWire[mOffsets[index]], mLengths[index], out);
+  });
+
+  // Only the expected value is left of the header, the size is packed
+  packed.headerWords = mHeaderWords ? mHeaderWords - 1 : 0;
+  packed.headers = mExpected;
+}
+
+void ProblemArena::compress() {
+  EncodedPayloads &compressed = mEncoded[COMPRESSED_WIRE];
+  encode(compressed, [&](size_t index, std::vector<unsigned char> &out) {
+    lzCompress(&mWire[mOffsets[index]], mLengths[index] * sizeof(unsigned), out);
+  });
+
+  const EncodedPayloads &packed = mEncoded[PACKED_WIRE];
+  EncodedPayloads &packedCompressed = mEncoded[PACKED_COMPRESSED_WIRE];
+  encode(packedCompressed, [&](size_t index, std::vector<unsigned char> &out) {
+    lzCompress(&packed.bytes[packed.offsets[index]], packed.lengths[index], out);
+  });
+  fillCompressedHeaders();
+}
+
+void ProblemArena::fillCompressedHeaders() {
+  EncodedPayloads &compressed = mEncoded[COMPRESSED_WIRE];
+  compressed.headerWords = mHeaderWords + 1;
+  compressed.headers.clear();
+  for (size_t i = 0; i < mOffsets.size(); ++i) {
+    compressed.headers.insert(compressed.headers.end(), &mHeaders[i * mHeaderWords],
+                              &mHeaders[i * mHeaderWords] + mHeaderWords);
+    compressed.headers.push_back(compressed.lengths[i]);
+  }
+
+  const EncodedPayloads &packed = mEncoded[PACKED_WIRE];
+  EncodedPayloads &packedCompressed = mEncoded[PACKED_COMPRESSED_WIRE];
+  packedCompressed.headerWords = packed.headerWords + 2;
+  packedCompressed.headers.clear();
+  for (size_t i = 0; i < mOffsets.size(); ++i) {
+    if (packed.headerWords)
+      packedCompressed.headers.push_back(packed.headers[i]);
+    packedCompressed.headers.push_back(packed.lengths[i]);
+    packedCompressed.headers.push_back(packedCompressed.lengths[i]);
+  }
+}
+
+double ProblemArena::measureDecoding() const {
+  auto start = std::chrono::steady_clock::now();
+  const EncodedPayloads &compressed = mEncoded[COMPRESSED_WIRE];
+  std::vector<unsigned> decoded;
+  std::unordered_set<size_t> seen;
+  for (size_t i = 0; i < mOffsets.size(); ++i) {
+    if (!seen.insert(compressed.offsets[i]).second)
+      continue;
+
+    decoded.resize(mLengths[i]);
+    boost::asio::const_buffer payload = getPayload(COMPRESSED_WIRE, i);
+    if (!lzDecompress(boost::asio::buffer_cast<const void *>(payload),
+                      boost::asio::buffer_size(payload), decoded.data(),
+                      decoded.size() * sizeof(unsigned)) ||
+        !std::equal(decoded.begin(), decoded.end(), getWire() + mOffsets[i]))
+      throw std::logic_error("compressed payload does not decode to the original");
+  }
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void ProblemArena::addMappedProblem(const MappedProblem &problem) {
+  mLengths.push_back(problem.size);
+  mAnswers.push_back(problem.answer);
+  mHeaderWords = problem.expectedValue ? 2 : 1;
+  if (problem.expectedValue) {
+    mExpected.push_back(problem.expectedValue.get());
+    mHeaders.push_back(problem.expectedValue.get());
+  }
+  mHeaders.push_back(problem.size);
+
+  // Payloads the dataset shares are recognised by their offset
+  size_t offset = problem.offsets[PLAIN_WIRE] / sizeof(unsigned);
+  mOffsets.push_back(offset);
+  if (mPayloads.count(offset)) {
+    ++mDuplicates;
+    mSavedWords += problem.size;
+  } else {
+    mPayloads.emplace(offset, std::make_pair(offset, problem.size));
+  }
+  for (int encoding = PLAIN_WIRE + 1; encoding < NB_WIRE_ENCODINGS; ++encoding) {
+    mEncoded[encoding].offsets.push_back(problem.offsets[encoding]);
+    mEncoded[encoding].lengths.push_back(problem.bytes[encoding]);
+  }
+}
+
+void ProblemArena::finishMapping() {
+  mPayloads.clear();
+  EncodedPayloads &packed = mEncoded[PACKED_WIRE];
+  packed.headerWords = mHeaderWords ? mHeaderWords - 1 : 0;
+  packed.headers = mExpected;
+  fillCompressedHeaders();
+}
+
+std::pair<uint64_t, size_t> ProblemArena::locate(WireEncoding encoding, size_t index) const {
+  if (encoding == PLAIN_WIRE)
+    return std::make_pair(uint64_t(mOffsets[index]) * sizeof(unsigned),
+                          size_t(mLengths[index]) * sizeof(unsigned));
+  return std::make_pair(uint64_t(mEncoded[encoding].offsets[index]),
+                        size_t(mEncoded[encoding].lengths[index]));
+}
+
+bool ProblemArena::appendPayload(WireEncoding encoding, size_t index,
+                                 std::vector<boost::asio::const_buffer> &buffers,
+                                 std::vector<uint32_t> &pages) const {
+  if (!mPaged) {
+    buffers.push_back(getPayload(encoding, index));
+    return true;
+  }
+
+  std::pair<uint64_t, size_t> payload = locate(encoding, index);
+  uint64_t offset = payload.first;
+  for (size_t left = payload.second; left > 0;) {
+    size_t within = offset % PageCache::PAGE_SIZE;
+    size_t bytes = std::min(left, PageCache::PAGE_SIZE - within);
+    uint32_t slot;
+    const char *page = mPaged->pin(offset / PageCache::PAGE_SIZE, slot);
+    if (!page)
+      return false;
+    pages.push_back(slot);
+    buffers.push_back(boost::asio::buffer(page + within, bytes));
+    offset += bytes;
+    left -= bytes;
+  }
+  return true;
+}
+
+void ProblemArena::prefetch(WireEncoding encoding, size_t index) const {
+  if (mPaged) {
+    std::pair<uint64_t, size_t> payload = locate(encoding, index);
+    mPaged->prefetch(payload.first, payload.second);
+  }
+}
+
+template <class T>
+static bool fillArena(const MappedFile &file, ProblemType type,
+                      ProblemArena &arena, LoadStats &stats, bool compress,
+                      unsigned shard, unsigned shards) {
+  // Every element of the shard is widened to a word on the wire; only the
+  // sizes are read to count them
+  size_t index = 0, words = 0;
+  scanProblems<T>(file.data(), file.size(), type, [&](const ProblemRecord &record) {
+    if (index++ % shards == shard)
+      words += record.size;
+  });
+  arena.reserve(words);
+
+  index = 0;
+  bool complete = scanProblems<T>(file.data(), file.size(), type,
+                                  [&](const ProblemRecord &record) {
+    if (index++ % shards != shard)
+      return;
+    arena.addProblem<T>(record);
+    ++stats.problems;
+  });
+
+  arena.finishLoading();
+  stats.duplicates = arena.getDuplicates();
+  stats.savedBytes = arena.getSavedBytes();
+  arena.pack(type);
+  stats.distinctBytes = arena.getDistinctBytes();
+  stats.packedBytes = arena.getEncodedBytes(PACKED_WIRE);
+  if (compress) {
+    arena.compress();
+    stats.compressedBytes = arena.getEncodedBytes(COMPRESSED_WIRE);
+    stats.packedCompressedBytes = arena.getEncodedBytes(PACKED_COMPRESSED_WIRE);
+    stats.decodeMilliseconds = arena.measureDecoding();
+  }
+  return complete;
+}
+
+LoadStats readProblem(const std::string &name, ProblemType type, ProblemContainer &problems,
+                      bool compress, unsigned shard, unsigned shards, PageCache *pages) {
+  auto start = std::chrono::steady_clock::now();
+  auto file = std::make_shared<MappedFile>(name);
+  LoadStats stats{ name, 0, file->size(), 0., 0, 0, 0, 0, 0, 0, 0. };
+
+  if (isDataset(*file)) {
+    // Serve the payloads from the file as they are, or page them in
+    bool valid;
+    if (pages) {
+      file.reset();
+      valid = pageDataset(name, *pages, type, problems.getArena(type), stats, compress, shard,
+                          shards);
+    } else {
+      valid = mapDataset(file, type, problems.getArena(type), stats, compress, shard, shards);
+    }
+    if (!valid)
+      std::cerr << name << " is not a valid " << getProblemTypeName(type) << " dataset, only "
+                << stats.problems << " problems were found" << std::endl;
+  } else {
+    // Find every problem and copy its payload in one go
+    bool complete = type < PASSWORD
+        ? fillArena<int>(*file, type, problems.getArena(type), stats, compress, shard, shards)
+        : fillArena<char>(*file, type, problems.getArena(type), stats, compress, shard, shards);
+
+    if (!complete)
+      std::cerr << name << " is truncated, only " << stats.problems
+                << " problems were read" << std::endl;
+  }
+
+  stats.milliseconds = std::chrono::duration<double, std::milli>(
+                           std::chrono::steady_clock::now() - start).count();
+  return stats;
+}
+
+void printLoadStats(const LoadStats &stats, std::ostream &out) {
+  out << std::fixed << std::setprecision(1) << stats.name << ": "
+            << stats.problems << " problems, " << stats.bytes / 1024. << " KiB in "
+            << stats.milliseconds << " ms ("
+            << stats.bytes / (stats.milliseconds * 1000. + 1e-9) << " MB/s), "
+            << stats.duplicates << " duplicate payloads ("
+            << 100. * stats.duplicates / std::max<size_t>(stats.problems, 1)
+            << "%), " << stats.savedBytes / 1024. << " KiB saved";
+  if (stats.distinctBytes)
+    out << ", payloads packed to " << 100. * stats.packedBytes / stats.distinctBytes << "%";
+  if (stats.compressedBytes)
+    out << ", compressed to "
+        << 100. * stats.compressedBytes / stats.distinctBytes << "% (decoded at "
+        << stats.distinctBytes / (stats.decodeMilliseconds * 1000. + 1e-9) << " MB/s), "
+        << 100. * stats.packedCompressedBytes / stats.distinctBytes << "% once packed";
+  out << std::endl;
+}
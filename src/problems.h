@@ -0,0 +1,458 @@
+#ifndef PROBLEMS_H
+#define PROBLEMS_H
+
+#include <boost/array.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/optional.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+enum ProblemType {
+  MAZE,
+  SUDOKU,
+  TREE,
+  ARRAY,
+  PASSWORD,
+  RLE,
+
+  NB_ELEMS
+};
+
+const char *getProblemTypeName(ProblemType type);
+bool parseProblemType(const std::string &name, ProblemType &type);
+
+// The category a set is named after, as in maze_small.bin
+bool guessProblemType(const std::string &name, ProblemType &type);
+
+// Type of the elements of a problem, as stored in its problem set
+template <ProblemType P> struct ProblemTraits { typedef int value_type; };
+template <> struct ProblemTraits<PASSWORD> { typedef char value_type; };
+template <> struct ProblemTraits<RLE> { typedef char value_type; };
+
+// A problem set (.bin) mapped read-only in memory. Missing or empty files
+// map to an empty range.
+class MappedFile {
+public:
+  explicit MappedFile(const std::string &name);
+
+  const char *data() const {
+    return static_cast<const char *>(mRegion.get_address());
+  }
+  size_t size() const { return mRegion.get_size(); }
+
+private:
+  boost::interprocess::file_mapping mFile;
+  boost::interprocess::mapped_region mRegion;
+};
+
+// A single problem as found in a problem set, its payload still pointing
+// into the file
+struct ProblemRecord {
+  bool answer;
+  boost::optional<int> expectedValue;
+  const char *payload;
+  unsigned size;
+};
+
+// Problem sets grouping other than 4 problems start with this magic and
+// the u32 number of problems per group
+const char WIDE_SET_MAGIC[4] = { 'C', 'S', 'G', 'W' };
+
+// Walks every problem of a problem set in a single pass. A set is a
+// sequence of groups made of a flag field holding the answers, an expected
+// value for RLE problems and size-prefixed payloads. Groups hold 4 problems
+// and a flag byte, or as many problems as a wide set header says and one
+// flag byte per 8 of them, bit i % 8 of byte i / 8 for problem i. The size
+// of an ARRAY problem accounts for its expected value which precedes the
+// payload. Returns false if the set is truncated.
+template <class T, class F>
+bool scanProblems(const char *data, size_t length, ProblemType type,
+                  F onRecord) {
+  const char *cur = data;
+  const char *end = data + length;
+  boost::optional<int> expectedValue = boost::none;
+  int tempInt;
+
+  auto readInt = [&](int &value) {
+    if (end - cur < static_cast<std::ptrdiff_t>(sizeof(value)))
+      return false;
+    std::memcpy(&value, cur, sizeof(value));
+    cur += sizeof(value);
+    return true;
+  };
+
+  // Flag bytes of original sets are below 16, they can't pass for the magic
+  int width = 4;
+  if (length >= sizeof(WIDE_SET_MAGIC) &&
+      std::memcmp(cur, WIDE_SET_MAGIC, sizeof(WIDE_SET_MAGIC)) == 0) {
+    cur += sizeof(WIDE_SET_MAGIC);
+    if (!readInt(width) || width <= 0)
+      return false;
+  }
+  const size_t flagBytes = (width + 7) / 8;
+
+  while (cur < end) {
+    // Read the flags
+    if (static_cast<size_t>(end - cur) < flagBytes)
+      return false;
+    const unsigned char *flags = reinterpret_cast<const unsigned char *>(cur);
+    cur += flagBytes;
+
+    // Read the expected value if this is a RLE problem
+    if (type == RLE) {
+      if (!readInt(tempInt))
+        return false;
+      expectedValue = tempInt;
+    }
+
+    // Find the problems of the group
+    for (int i = 0; i < width; ++i) {
+      ProblemRecord record;
+      if (!readInt(tempInt))
+        return false;
+      record.size = tempInt;
+
+      // Read the expected value if this is an array problem
+      if (type == ARRAY) {
+        if (record.size == 0 || !readInt(tempInt))
+          return false;
+        expectedValue = tempInt;
+        --record.size;
+      }
+
+      if (static_cast<size_t>(end - cur) < record.size * sizeof(T))
+        return false;
+      record.answer = flags[i / 8] & (1 << (i % 8));
+      record.expectedValue = expectedValue;
+      record.payload = cur;
+      cur += record.size * sizeof(T);
+      onRecord(record);
+    }
+  }
+
+  return true;
+}
+
+// Typed, read-only view over the payload of a problem
+template <ProblemType P> class ProblemView {
+public:
+  typedef typename ProblemTraits<P>::value_type value_type;
+
+  ProblemView(const unsigned *data, size_t size) : mData(data), mSize(size) {}
+
+  value_type operator[](size_t index) const {
+    return static_cast<value_type>(mData[index]);
+  }
+  size_t size() const { return mSize; }
+
+private:
+  const unsigned *mData;
+  size_t mSize;
+};
+
+// How problems go on the wire, as negotiated by each connection
+enum WireEncoding {
+  // [expected value] size, one u32 per element
+  PLAIN_WIRE,
+  // [expected value] size, compressed bytes, compressed payload
+  COMPRESSED_WIRE,
+  // [expected value] payload packed as in packing.h
+  PACKED_WIRE,
+  // [expected value] packed bytes, compressed bytes, compressed packed payload
+  PACKED_COMPRESSED_WIRE,
+
+  NB_WIRE_ENCODINGS
+};
+
+// Appends a payload of the category packed as in packing.h
+void packPayload(ProblemType type, const unsigned *data, size_t size,
+                 std::vector<unsigned char> &out);
+
+class PagedFile;
+
+// A problem whose payloads, in every encoding, are already laid out in a
+// file, as in a dataset (dataset.h). Offsets are from the start of the
+// file.
+struct MappedProblem {
+  bool answer;
+  boost::optional<int> expectedValue;
+  unsigned size;
+  boost::array<size_t, NB_WIRE_ENCODINGS> offsets;
+  boost::array<unsigned, NB_WIRE_ENCODINGS> bytes;
+};
+
+// Hash of a payload, to find identical ones
+inline uint64_t hashWords(const unsigned *data, size_t count) {
+  uint64_t hash = 0xcbf29ce484222325ULL ^ count;
+  for (size_t i = 0; i < count; ++i) {
+    hash ^= data[i];
+    hash *= 0x100000001b3ULL;
+    hash ^= hash >> 29;
+  }
+  return hash;
+}
+
+// All the problems of a category. Payloads are stored back to back with
+// every element widened to 32 bits, as they go on the wire, and identical
+// payloads are only stored once. The wire header of each problem,
+// [expected value] size, and everything else live in arrays indexed by
+// problem. Problems of a dataset leave their payloads in the file, which
+// the arena then keeps mapped, or reads a page at a time through a page
+// cache (page_cache.h); an arena holds one kind or the other.
+class ProblemArena {
+public:
+  ProblemArena() : mHeaderWords(0), mDuplicates(0), mSavedWords(0) {}
+
+  template <class T> void addProblem(const ProblemRecord &record) {
+    mLengths.push_back(record.size);
+    mAnswers.push_back(record.answer);
+    mHeaderWords = record.expectedValue ? 2 : 1;
+    if (record.expectedValue) {
+      mExpected.push_back(record.expectedValue.get());
+      mHeaders.push_back(record.expectedValue.get());
+    }
+    mHeaders.push_back(record.size);
+
+    // Widen the payload in place, then drop it again if it is already there
+    size_t start = mWire.size();
+    mWire.resize(start + record.size);
+    unsigned *payload = mWire.data() + start;
+    if (sizeof(T) == sizeof(unsigned)) {
+      std::memcpy(payload, record.payload, record.size * sizeof(T));
+    } else {
+      auto data = reinterpret_cast<const T *>(record.payload);
+      std::copy(data, data + record.size, payload);
+    }
+
+    uint64_t hash = hashWords(payload, record.size);
+    auto candidates = mPayloads.equal_range(hash);
+    for (auto it = candidates.first; it != candidates.second; ++it) {
+      size_t offset = it->second.first;
+      if (it->second.second == record.size &&
+          std::equal(payload, payload + record.size, mWire.data() + offset)) {
+        mWire.resize(start);
+        mOffsets.push_back(offset);
+        ++mDuplicates;
+        mSavedWords += record.size;
+        return;
+      }
+    }
+    mPayloads.emplace(hash, std::make_pair(start, record.size));
+    mOffsets.push_back(start);
+  }
+
+  // Serves the problems of a dataset from its mapping, or from its pages
+  // read on demand. The problems are then added one by one, and
+  // finishMapping() fills in their headers.
+  void mapFrom(std::shared_ptr<const MappedFile> file) { mFile = std::move(file); }
+  void pageFrom(std::shared_ptr<PagedFile> file) { mPaged = std::move(file); }
+  void addMappedProblem(const MappedProblem &problem);
+  void finishMapping();
+
+  bool isPaged() const { return mPaged != nullptr; }
+
+  void reserve(size_t wireWords) { mWire.reserve(wireWords); }
+
+  // Drops what was only needed to find duplicates and gives back the room
+  // reserved for payloads that were shared
+  void finishLoading() {
+    mPayloads.clear();
+    mWire.shrink_to_fit();
+  }
+
+  size_t size() const { return mOffsets.size(); }
+
+  // Problems whose payload is shared with an earlier one, and the bytes
+  // that sharing saves
+  size_t getDuplicates() const { return mDuplicates; }
+  size_t getSavedBytes() const { return mSavedWords * sizeof(unsigned); }
+
+  bool getAnswer(size_t index) const { return mAnswers[index]; }
+
+  unsigned getLength(size_t index) const { return mLengths[index]; }
+
+  boost::optional<unsigned> getExpectedValue(size_t index) const {
+    if (mExpected.empty())
+      return boost::none;
+    return mExpected[index];
+  }
+
+  // A problem goes on the wire as its header followed by its payload. The
+  // payload of a paged problem is only found with appendPayload().
+  boost::asio::const_buffer getWireHeader(size_t index) const {
+    return boost::asio::buffer(&mHeaders[index * mHeaderWords],
+                               mHeaderWords * sizeof(unsigned));
+  }
+
+  boost::asio::const_buffer getPayload(size_t index) const {
+    return boost::asio::buffer(getWire() + mOffsets[index], mLengths[index] * sizeof(unsigned));
+  }
+
+  // Throws std::logic_error on a paged arena, as does getPayload()
+  template <ProblemType P> ProblemView<P> getData(size_t index) const {
+    return ProblemView<P>(getWire() + mOffsets[index], mLengths[index]);
+  }
+
+  // Encodes every distinct payload once more for the clients that
+  // negotiated it: packed is always there, the compressed ones only once
+  // compress() has been called
+  void pack(ProblemType type);
+  void compress();
+
+  // Decodes every distinct compressed payload, checking it gives back the
+  // original, and returns how long that took in milliseconds
+  double measureDecoding() const;
+
+  size_t getDistinctBytes() const { return mWire.size() * sizeof(unsigned); }
+  size_t getEncodedBytes(WireEncoding encoding) const { return mEncoded[encoding].bytes.size(); }
+
+  // A problem goes on the wire as its header followed by its payload, in
+  // the encoding the connection negotiated
+  boost::asio::const_buffer getWireHeader(WireEncoding encoding, size_t index) const {
+    if (encoding == PLAIN_WIRE)
+      return getWireHeader(index);
+    const EncodedPayloads &encoded = mEncoded[encoding];
+    return boost::asio::buffer(encoded.headers.data() + index * encoded.headerWords,
+                               encoded.headerWords * sizeof(unsigned));
+  }
+
+  boost::asio::const_buffer getPayload(WireEncoding encoding, size_t index) const {
+    if (encoding == PLAIN_WIRE)
+      return getPayload(index);
+    const EncodedPayloads &encoded = mEncoded[encoding];
+    return boost::asio::buffer(getEncoded(encoding) + encoded.offsets[index],
+                               encoded.lengths[index]);
+  }
+
+  // Appends the payload of a problem to `buffers`. A paged problem takes a
+  // buffer for every page it spans, each pinned in `pages` until the caller
+  // unpins it from the page cache. False if a page could not be read, with
+  // the pages pinned before it still in `pages`.
+  bool appendPayload(WireEncoding encoding, size_t index,
+                     std::vector<boost::asio::const_buffer> &buffers,
+                     std::vector<uint32_t> &pages) const;
+
+  // Has the pages of a paged problem read ahead of its use
+  void prefetch(WireEncoding encoding, size_t index) const;
+
+private:
+  // The payloads of a paged arena are not in memory, they can only be
+  // reached a page at a time through appendPayload()
+  const unsigned *getWire() const {
+    checkNotPaged();
+    return mFile ? reinterpret_cast<const unsigned *>(mFile->data()) : mWire.data();
+  }
+  const unsigned char *getEncoded(WireEncoding encoding) const {
+    checkNotPaged();
+    return mFile ? reinterpret_cast<const unsigned char *>(mFile->data())
+                 : mEncoded[encoding].bytes.data();
+  }
+
+  void checkNotPaged() const {
+    if (mPaged)
+      throw std::logic_error("payloads of a paged arena are only read through appendPayload()");
+  }
+
+  void fillCompressedHeaders();
+
+  // Where the payload of a problem is in its dataset, in bytes
+  std::pair<uint64_t, size_t> locate(WireEncoding encoding, size_t index) const;
+
+  // The dataset the payloads are in, if they were mapped or are paged
+  std::shared_ptr<const MappedFile> mFile;
+  std::shared_ptr<PagedFile> mPaged;
+  std::vector<unsigned> mWire;
+  std::vector<unsigned> mHeaders;
+  size_t mHeaderWords;
+  std::vector<size_t> mOffsets;
+  std::vector<unsigned> mLengths;
+  std::vector<unsigned> mExpected;
+  std::vector<unsigned char> mAnswers;
+
+  // Offset and length of the distinct payloads by hash, while loading
+  std::unordered_multimap<uint64_t, std::pair<size_t, unsigned>> mPayloads;
+  size_t mDuplicates;
+  size_t mSavedWords;
+
+  // The payloads in the other encodings, shared like the others, and the
+  // headers that go with them
+  struct EncodedPayloads {
+    std::vector<unsigned char> bytes;
+    std::vector<size_t> offsets;
+    std::vector<unsigned> lengths;
+    std::vector<unsigned> headers;
+    size_t headerWords = 0;
+  };
+
+  template <class Encode> void encode(EncodedPayloads &encoded, Encode encodePayload);
+
+  boost::array<EncodedPayloads, NB_WIRE_ENCODINGS> mEncoded;
+};
+
+class ProblemContainer {
+public:
+  ProblemArena &getArena(ProblemType type) { return mArenas[type]; }
+  const ProblemArena &getArena(ProblemType type) const { return mArenas[type]; }
+
+  size_t getProblemSize(ProblemType type) const { return mArenas[type].size(); }
+
+  bool isPaged() const {
+    return std::any_of(mArenas.begin(), mArenas.end(),
+                       [](const ProblemArena &arena) { return arena.isPaged(); });
+  }
+
+  size_t getGlobalSize() const {
+    size_t size = 0;
+    for (auto &arena : mArenas)
+      size += arena.size();
+    return size;
+  }
+
+  template <ProblemType P> ProblemView<P> getData(size_t index) const {
+    return mArenas[P].template getData<P>(index);
+  }
+
+private:
+  boost::array<ProblemArena, ProblemType::NB_ELEMS> mArenas;
+};
+
+struct LoadStats {
+  std::string name;
+  size_t problems;
+  size_t bytes;
+  double milliseconds;
+  size_t duplicates;
+  size_t savedBytes;
+  // Payloads once shared, then packed, and compressed if they were
+  size_t distinctBytes;
+  size_t packedBytes;
+  size_t compressedBytes;
+  size_t packedCompressedBytes;
+  double decodeMilliseconds;
+};
+
+class PageCache;
+
+// Fills the arena of a category from a problem set. Each category only
+// touches its own arena, so the sets can be read side by side. A shard of a
+// sharded server only keeps problem `shard` of the set and every `shards`-th
+// one after it. Given a page cache, datasets are paged through it rather
+// than mapped.
+LoadStats readProblem(const std::string &name, ProblemType type, ProblemContainer &problems,
+                      bool compress, unsigned shard = 0, unsigned shards = 1,
+                      PageCache *pages = nullptr);
+
+void printLoadStats(const LoadStats &stats, std::ostream &out);
+
+#endif // PROBLEMS_H
@@ -0,0 +1,115 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <boost/array.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Connection handshake, shared by the server and the client.
+//
+// A client that wants more than the original protocol sends a Hello as
+// soon as it is connected. By then the server has already sent it a first
+// batch the original way: on reading the Hello, the server withdraws that
+// batch (no points won or lost) and confirms with an Ack holding what it
+// agreed to.
+//
+// Only servers that know about the handshake may be sent a Hello: one that
+// does not reads it as answers to its first batch and goes on reading the
+// rest of it as answers too, so the two sides never agree on where a
+// message starts again. Asking for more than the original protocol is
+// therefore up to the user of the client, who knows which server it talks
+// to, and a client that does not read an Ack gives up.
+//
+//   Hello  u32 HELLO_MAGIC, u32 version, u32 count, count x u32 options
+//   Ack    u32 ACK_MAGIC,   u32 version, u32 count, count x u32 options
+//
+// Options come in HandshakeOption order. Options a side does not know are
+// ignored, options it does not get keep their default.
+//
+// Both sides then speak the lower of their two versions, the one in the
+// Ack. From version 2, payloads are packed as described in packing.h
+// rather than sent as one u32 per element.
+const uint32_t HELLO_MAGIC = 0x48475343; // "CSGH"
+const uint32_t ACK_MAGIC = 0x41475343;   // "CSGA"
+const uint32_t PROTOCOL_VERSION = 2;
+const uint32_t PACKED_PROTOCOL_VERSION = 2;
+const uint32_t MAX_HANDSHAKE_OPTIONS = 64;
+
+const uint32_t MAX_BATCH_WIDTH = 256;
+
+// Once the handshake is done, every batch starts with its u32 sequence
+// number before the problem type and holds OPT_BATCH_WIDTH problems. Every
+// answer is the sequence number of the batch it answers followed by its
+// answers as a bitmap of u32 words, bit i of word i / 32 for problem i.
+// Answers may come back in any order.
+enum HandshakeOption {
+  // Batches the server keeps in flight at once
+  OPT_WINDOW,
+  // Problems per batch, up to MAX_BATCH_WIDTH
+  OPT_BATCH_WIDTH,
+  // Asked as 1 by clients on the same machine, answered with the key of
+  // the shared ring the batches will be written to, or 0 for none
+  OPT_SHARED_RING,
+  // Asked as 1 for problems compressed with the codec of lz.h, answered
+  // with 1 if they will be
+  OPT_COMPRESSION,
+
+  NB_OPTIONS
+};
+
+typedef boost::array<uint32_t, NB_OPTIONS> HandshakeOptions;
+
+inline HandshakeOptions defaultHandshakeOptions() {
+  HandshakeOptions options;
+  options[OPT_WINDOW] = 1;
+  options[OPT_BATCH_WIDTH] = 4;
+  options[OPT_SHARED_RING] = 0;
+  options[OPT_COMPRESSION] = 0;
+  return options;
+}
+
+// With a shared ring, the server writes the problems of each batch once in
+// a shared memory segment mapped by both sides, in the same framing as on
+// the socket. The socket then only carries
+//
+//   u32 sequence number, u32 problem type, u32 offset, u32 bytes
+//
+// where the problems are found at that offset of the ring. A batch that
+// does not fit in the ring has NO_RING_OFFSET instead, and its problems
+// follow on the socket. The ring space of a batch is reused once it has
+// been answered or has expired.
+//
+// A client may still be reading a batch from the ring when it expires, so
+// the u32 before the problems holds the sequence number of the batch for
+// as long as its space is in use. The server sets it to RELEASED_RING_TAG
+// before it writes anything else over that space, and a client that does
+// not find the sequence number there both before and after reading the
+// problems drops the batch: it has expired by then anyway.
+const uint32_t NO_RING_OFFSET = 0xFFFFFFFF;
+const uint32_t RELEASED_RING_TAG = 0;
+
+// With compression, every problem of a batch is sent as
+//
+//   [u32 expected value] u32 size, u32 compressed bytes, compressed payload
+//
+// where the payload decodes to the usual size x u32 elements, or from
+// version 2 as
+//
+//   [u32 expected value] u32 packed bytes, u32 compressed bytes, compressed payload
+//
+// where the payload decodes to the packed payload.
+
+// Name of the shared memory segment of a ring
+inline std::string sharedRingName(uint32_t key) {
+  char name[32];
+  std::snprintf(name, sizeof(name), "csgames-ring-%08x", key);
+  return name;
+}
+
+// Words of the answer bitmap of a batch
+inline size_t answerWords(uint32_t width) { return (width + 31) / 32; }
+
+#endif // PROTOCOL_H
@@ -0,0 +1,90 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <boost/array.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// Bounded lock-free ring buffer for many producers and a single consumer.
+// Each cell carries a sequence number telling whether it is free to be
+// written or ready to be read (Vyukov's bounded queue), so producers only
+// contend on a compare-and-swap of the write position and a full ring
+// makes tryPush fail instead of blocking. N must be a power of two.
+template <class T, size_t N> class RingBuffer {
+  static_assert((N & (N - 1)) == 0, "RingBuffer size must be a power of two");
+
+public:
+  RingBuffer() : mWritePos(0), mReadPos(0) {
+    for (size_t i = 0; i < N; ++i)
+      mCells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  bool tryPush(const T &value) {
+    Cell *cell;
+    size_t pos = mWritePos.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &mCells[pos & (N - 1)];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (mWritePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = mWritePos.load(std::memory_order_relaxed);
+      }
+    }
+
+    cell->value = value;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Only ever called from the consumer
+  bool tryPop(T &value) {
+    size_t pos = mReadPos.load(std::memory_order_relaxed);
+    Cell &cell = mCells[pos & (N - 1)];
+    if (cell.sequence.load(std::memory_order_acquire) != pos + 1)
+      return false;
+
+    value = cell.value;
+    mReadPos.store(pos + 1, std::memory_order_relaxed);
+    cell.sequence.store(pos + N, std::memory_order_release);
+    return true;
+  }
+
+  // Approximate, the producers and the consumer keep moving
+  size_t size() const {
+    return mWritePos.load(std::memory_order_relaxed) -
+           mReadPos.load(std::memory_order_relaxed);
+  }
+
+  static size_t capacity() { return N; }
+
+  // Before C++17, plain new only aligns to 16 bytes, not to the cache lines
+  // the positions are kept on
+  static void *operator new(size_t size) {
+    void *memory;
+    if (posix_memalign(&memory, alignof(RingBuffer), size) != 0)
+      throw std::bad_alloc();
+    return memory;
+  }
+  static void operator delete(void *memory) { std::free(memory); }
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  boost::array<Cell, N> mCells;
+  alignas(64) std::atomic<size_t> mWritePos;
+  alignas(64) std::atomic<size_t> mReadPos;
+};
+
+#endif // RING_BUFFER_H
@@ -0,0 +1,169 @@
+#include "sampler.h"
+
+#include <iomanip>
+#include <numeric>
+#include <ostream>
+#include <sstream>
+
+AliasTable::AliasTable(const std::vector<double> &weights) {
+  double total = std::accumulate(weights.begin(), weights.end(), 0.);
+  if (!(total > 0.))
+    return;
+
+  // Scale the weights so they average 1, then pair every column under 1
+  // with one over 1 that tops it up (Vose's construction)
+  size_t n = weights.size();
+  mProbabilities.resize(n);
+  mAliases.resize(n);
+  std::vector<double> scaled(n);
+  std::vector<size_t> small, large;
+  for (size_t i = 0; i < n; ++i) {
+    scaled[i] = weights[i] * n / total;
+    (scaled[i] < 1. ? small : large).push_back(i);
+  }
+
+  while (!small.empty() && !large.empty()) {
+    size_t less = small.back();
+    small.pop_back();
+    size_t more = large.back();
+
+    mProbabilities[less] = scaled[less];
+    mAliases[less] = more;
+    scaled[more] -= 1. - scaled[less];
+    if (scaled[more] < 1.) {
+      large.pop_back();
+      small.push_back(more);
+    }
+  }
+
+  // What is left is 1 give or take rounding errors
+  for (size_t i : large) {
+    mProbabilities[i] = 1.;
+    mAliases[i] = i;
+  }
+  for (size_t i : small) {
+    mProbabilities[i] = 1.;
+    mAliases[i] = i;
+  }
+}
+
+SamplerConfig::SamplerConfig() {
+  categoryWeights.fill(1.);
+  largestOnly.fill(false);
+}
+
+static bool parseWeight(const std::string &text, double &weight) {
+  std::istringstream in(text);
+  return (in >> weight) && in.eof() && weight >= 0.;
+}
+
+bool parseCategoryWeights(const std::string &text, SamplerConfig &config) {
+  std::istringstream in(text);
+  for (std::string item; std::getline(in, item, ',');) {
+    size_t equal = item.find('=');
+    ProblemType type;
+    if (equal == std::string::npos ||
+        !parseProblemType(item.substr(0, equal), type) ||
+        !parseWeight(item.substr(equal + 1), config.categoryWeights[type]))
+      return false;
+  }
+  return true;
+}
+
+bool parseSizeWeights(const std::string &text, SamplerConfig &config) {
+  size_t equal = text.find('=');
+  ProblemType type;
+  if (equal == std::string::npos || !parseProblemType(text.substr(0, equal), type))
+    return false;
+
+  std::string classes = text.substr(equal + 1);
+  if (classes == "largest") {
+    config.largestOnly[type] = true;
+    return true;
+  }
+
+  auto &weights = config.sizeWeights[type];
+  weights.assign(ProblemSampler::NB_SIZE_CLASSES, 0.);
+  std::istringstream in(classes);
+  for (std::string item; std::getline(in, item, ',');) {
+    size_t colon = item.find(':');
+    std::string name = item.substr(0, colon);
+    int sizeClass = 0;
+    while (sizeClass < ProblemSampler::NB_SIZE_CLASSES &&
+           name != ProblemSampler::getSizeClassName(sizeClass))
+      ++sizeClass;
+    if (sizeClass == ProblemSampler::NB_SIZE_CLASSES)
+      return false;
+
+    double weight = 1.;
+    if (colon != std::string::npos && !parseWeight(item.substr(colon + 1), weight))
+      return false;
+    weights[sizeClass] = weight;
+  }
+  return true;
+}
+
+int ProblemSampler::sizeClassOf(size_t elements) {
+  int sizeClass = 0;
+  for (elements >>= 8; elements > 0 && sizeClass < NB_SIZE_CLASSES - 1; elements >>= 2)
+    ++sizeClass;
+  return sizeClass;
+}
+
+const char *ProblemSampler::getSizeClassName(int sizeClass) {
+  static const char *names[NB_SIZE_CLASSES] = {
+    "256", "1K", "4K", "16K", "64K", "256K", "1M", "more"
+  };
+  return names[sizeClass];
+}
+
+bool ProblemSampler::build(const ProblemContainer &problems, const SamplerConfig &config) {
+  mCategoryWeights.assign(ProblemType::NB_ELEMS, 0.);
+
+  for (int type = 0; type < ProblemType::NB_ELEMS; ++type) {
+    auto &arena = problems.getArena(static_cast<ProblemType>(type));
+    auto &indices = mIndices[type];
+    for (size_t i = 0; i < arena.size(); ++i)
+      indices[sizeClassOf(arena.getLength(i))].push_back(i);
+
+    auto &weights = mWeights[type];
+    weights.assign(NB_SIZE_CLASSES, 0.);
+    for (int sizeClass = 0; sizeClass < NB_SIZE_CLASSES; ++sizeClass) {
+      if (indices[sizeClass].empty())
+        continue;
+      if (config.largestOnly[type])
+        weights.assign(NB_SIZE_CLASSES, 0.);
+      if (config.largestOnly[type] || config.sizeWeights[type].empty())
+        weights[sizeClass] = indices[sizeClass].size();
+      else
+        weights[sizeClass] = config.sizeWeights[type][sizeClass];
+    }
+
+    // A category with nothing left to draw is never picked
+    mSizeClasses[type] = AliasTable(weights);
+    if (!mSizeClasses[type].empty())
+      mCategoryWeights[type] = config.categoryWeights[type];
+  }
+
+  mCategories = AliasTable(mCategoryWeights);
+  return !mCategories.empty();
+}
+
+void ProblemSampler::print(std::ostream &out) const {
+  for (int type = 0; type < ProblemType::NB_ELEMS; ++type) {
+    if (!(mCategoryWeights[type] > 0.))
+      continue;
+    out << std::left << std::setw(10) << getProblemTypeName(static_cast<ProblemType>(type))
+        << " weight " << mCategoryWeights[type];
+    const char *separator = ": ";
+    for (int sizeClass = 0; sizeClass < NB_SIZE_CLASSES; ++sizeClass) {
+      if (mWeights[type][sizeClass] > 0.) {
+        out << separator << mIndices[type][sizeClass].size()
+            << (sizeClass < NB_SIZE_CLASSES - 1 ? " under " : " of ")
+            << getSizeClassName(sizeClass);
+        separator = ", ";
+      }
+    }
+    out << std::right << std::endl;
+  }
+}
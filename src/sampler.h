@@ -0,0 +1,87 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "problems.h"
+
+#include <boost/array.hpp>
+
+#include <ostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Walker's alias method: draws index i with probability weights[i] / sum in
+// constant time, from one uniform column and one biased coin flip. Zero
+// weights are never drawn; a table whose weights are all zero is empty.
+class AliasTable {
+public:
+  AliasTable() {}
+  explicit AliasTable(const std::vector<double> &weights);
+
+  bool empty() const { return mProbabilities.empty(); }
+
+  template <class Engine> size_t sample(Engine &engine) const {
+    size_t column = std::uniform_int_distribution<size_t>(
+        0, mProbabilities.size() - 1)(engine);
+    double coin = std::uniform_real_distribution<double>(0., 1.)(engine);
+    return coin < mProbabilities[column] ? column : mAliases[column];
+  }
+
+private:
+  std::vector<double> mProbabilities;
+  std::vector<size_t> mAliases;
+};
+
+// What the sampler should favour. Categories weigh 1 unless told otherwise.
+// Size weights of a category apply to its size classes; when there are none,
+// each class weighs its number of problems so every problem is as likely.
+struct SamplerConfig {
+  SamplerConfig();
+
+  boost::array<double, ProblemType::NB_ELEMS> categoryWeights;
+  boost::array<std::vector<double>, ProblemType::NB_ELEMS> sizeWeights;
+  boost::array<bool, ProblemType::NB_ELEMS> largestOnly;
+};
+
+// Parses "maze=2,tree=0" into category weights
+bool parseCategoryWeights(const std::string &text, SamplerConfig &config);
+
+// Parses "maze=4K:1,16K:3" or "maze=largest" into the size weights of one
+// category, classes left out weigh nothing
+bool parseSizeWeights(const std::string &text, SamplerConfig &config);
+
+// Picks the category of a batch and its problems, in constant time. Each
+// category is split in size classes of powers of 4 elements (under 256,
+// under 1K, ... under 1M and more); a problem is drawn by picking a class
+// then a problem of the class uniformly. Built once after loading.
+class ProblemSampler {
+public:
+  static const int NB_SIZE_CLASSES = 8;
+
+  static int sizeClassOf(size_t elements);
+  static const char *getSizeClassName(int sizeClass);
+
+  // Returns false if the configuration leaves nothing to send
+  bool build(const ProblemContainer &problems, const SamplerConfig &config);
+
+  // Writes the problems each category draws from, by size class
+  void print(std::ostream &out) const;
+
+  template <class Engine> ProblemType sampleCategory(Engine &engine) const {
+    return static_cast<ProblemType>(mCategories.sample(engine));
+  }
+
+  template <class Engine> size_t sampleProblem(ProblemType type, Engine &engine) const {
+    auto &indices = mIndices[type][mSizeClasses[type].sample(engine)];
+    return indices[std::uniform_int_distribution<size_t>(0, indices.size() - 1)(engine)];
+  }
+
+private:
+  AliasTable mCategories;
+  boost::array<AliasTable, ProblemType::NB_ELEMS> mSizeClasses;
+  boost::array<boost::array<std::vector<uint32_t>, NB_SIZE_CLASSES>, ProblemType::NB_ELEMS> mIndices;
+  boost::array<std::vector<double>, ProblemType::NB_ELEMS> mWeights;
+  std::vector<double> mCategoryWeights;
+};
+
+#endif // SAMPLER_H
@@ -0,0 +1,81 @@
+#include "scoreboard.h"
+
+#include <boost/interprocess/anonymous_shared_memory.hpp>
+#include <boost/interprocess/exceptions.hpp>
+
+#include <new>
+
+using namespace boost::interprocess;
+
+Scoreboard::Slot::Slot() : score(0) {
+  for (auto &counters : categories)
+    for (auto &counter : counters)
+      counter.store(0, std::memory_order_relaxed);
+  for (auto &counter : server)
+    counter.store(0, std::memory_order_relaxed);
+}
+
+std::unique_ptr<Scoreboard> Scoreboard::create(unsigned shards) {
+  try {
+    return std::unique_ptr<Scoreboard>(
+        new Scoreboard(shards, anonymous_shared_memory(shards * sizeof(Slot))));
+  } catch (const interprocess_exception &) {
+    return nullptr;
+  }
+}
+
+Scoreboard::Scoreboard(unsigned shards, mapped_region &&region)
+    : mShards(shards), mRegion(std::move(region)),
+      mSlots(static_cast<Slot *>(mRegion.get_address())) {
+  // Slots only hold atomics, there is nothing to destroy
+  for (unsigned shard = 0; shard < shards; ++shard)
+    new (&mSlots[shard]) Slot;
+}
+
+void Scoreboard::publish(unsigned shard, int score, const StatsSnapshot &snapshot,
+                         const LatencyTable &latencies) {
+  Slot &slot = mSlots[shard];
+  slot.score.store(score, std::memory_order_relaxed);
+  for (int type = 0; type < ProblemType::NB_ELEMS; ++type)
+    for (int counter = 0; counter < NB_CATEGORY_COUNTERS; ++counter)
+      slot.categories[type][counter].store(snapshot.categories[type][counter],
+                                           std::memory_order_relaxed);
+  for (int counter = 0; counter < NB_SERVER_COUNTERS; ++counter)
+    slot.server[counter].store(snapshot.server[counter], std::memory_order_relaxed);
+  slot.latencies.assign(latencies);
+}
+
+int Scoreboard::getScore(unsigned shard) const {
+  return mSlots[shard].score.load(std::memory_order_relaxed);
+}
+
+int Scoreboard::getScore() const {
+  int score = 0;
+  for (unsigned shard = 0; shard < mShards; ++shard)
+    score += getScore(shard);
+  return score;
+}
+
+StatsSnapshot Scoreboard::snapshot() const {
+  StatsSnapshot snapshot;
+  for (auto &counters : snapshot.categories)
+    counters.fill(0);
+  snapshot.server.fill(0);
+
+  for (unsigned shard = 0; shard < mShards; ++shard) {
+    const Slot &slot = mSlots[shard];
+    for (int type = 0; type < ProblemType::NB_ELEMS; ++type)
+      for (int counter = 0; counter < NB_CATEGORY_COUNTERS; ++counter)
+        snapshot.categories[type][counter] +=
+            slot.categories[type][counter].load(std::memory_order_relaxed);
+    for (int counter = 0; counter < NB_SERVER_COUNTERS; ++counter)
+      snapshot.server[counter] += slot.server[counter].load(std::memory_order_relaxed);
+  }
+  return snapshot;
+}
+
+void Scoreboard::collectLatencies(LatencyTable &latencies) const {
+  latencies.assign(mSlots[0].latencies);
+  for (unsigned shard = 1; shard < mShards; ++shard)
+    latencies.add(mSlots[shard].latencies);
+}
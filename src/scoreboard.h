@@ -0,0 +1,58 @@
+#ifndef SCOREBOARD_H
+#define SCOREBOARD_H
+
+#include "histogram.h"
+#include "problems.h"
+#include "stats.h"
+
+#include <boost/array.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// Score, counters and latencies of every shard of a sharded server, in
+// memory shared by the shards and the process that started them. Each
+// shard publishes its own slot from time to time and once more before it
+// exits; the starting process sums the slots to report on the whole game.
+// Everything in it is a lock-free atomic, so the processes need no lock.
+class Scoreboard {
+public:
+  // Null if the memory could not be mapped. It has to be created before
+  // the shards are forked for them to share it.
+  static std::unique_ptr<Scoreboard> create(unsigned shards);
+
+  Scoreboard(const Scoreboard &) = delete;
+  Scoreboard &operator=(const Scoreboard &) = delete;
+
+  unsigned size() const { return mShards; }
+
+  void publish(unsigned shard, int score, const StatsSnapshot &snapshot,
+               const LatencyTable &latencies);
+
+  int getScore(unsigned shard) const;
+
+  // Summed over every shard
+  int getScore() const;
+  StatsSnapshot snapshot() const;
+  void collectLatencies(LatencyTable &latencies) const;
+
+private:
+  struct Slot {
+    Slot();
+
+    std::atomic<int> score;
+    boost::array<boost::array<std::atomic<uint64_t>, NB_CATEGORY_COUNTERS>, ProblemType::NB_ELEMS> categories;
+    boost::array<std::atomic<uint64_t>, NB_SERVER_COUNTERS> server;
+    LatencyTable latencies;
+  };
+
+  Scoreboard(unsigned shards, boost::interprocess::mapped_region &&region);
+
+  unsigned mShards;
+  boost::interprocess::mapped_region mRegion;
+  Slot *mSlots;
+};
+
+#endif // SCOREBOARD_H
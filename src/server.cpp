@@ -1,266 +1,771 @@
 #include "base64.h"
+#include "deadline.h"
+#include "generator.h"
+#include "histogram.h"
+#include "logger.h"
+#include "page_cache.h"
+#include "problem_store.h"
+#include "problems.h"
+#include "protocol.h"
+#include "sampler.h"
+#include "scoreboard.h"
+#include "shared_ring.h"
+#include "stats.h"
 #include "strings.h"
+#include "timer_wheel.h"
+#include "trace.h"
 
 #include <boost/array.hpp>
 #include <boost/asio.hpp>
 #include <boost/asio/buffer.hpp>
+#include <boost/asio/generic/stream_protocol.hpp>
 #include <boost/bind.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/optional.hpp>
+#include <boost/program_options.hpp>
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
-#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <deque>
 #include <iostream>
 #include <memory>
 #include <numeric>
+#include <sstream>
 #include <string>
 #include <random>
 #include <thread>
 
-using boost::asio::ip::tcp;
-
-enum ProblemType {
-  MAZE,
-  SUDOKU,
-  TREE,
-  ARRAY,
-  PASSWORD,
-  RLE,
-
-  NB_ELEMS
-};
-
-class BaseProblem {
-public:
-  virtual ~BaseProblem() {}
-
-public:
-  template <class T> void init(bool answer, std::vector<T> &&data, const boost::optional<int>& expectedValue);
-
-  virtual bool getAnswer() const = 0;
-  virtual boost::optional<unsigned> getExpectedValue() const = 0;
-  virtual size_t size() const = 0;
-
-  template <class T> const std::vector<T> &getData() const;
-};
-
-template <class T> class ConcreteProblem : public BaseProblem {
-public:
-  virtual ~ConcreteProblem() {}
-
-public:
-    void init(bool answer, std::vector<T> &&data, const boost::optional<int>& expectedValue)
-    {
-        mAnswer = answer;
-        mData = data;
-        mExpected = expectedValue;
-    }
-
-    bool getAnswer() const override { return mAnswer; }
-    boost::optional<unsigned> getExpectedValue() const override {
-      return mExpected;
-    }
-    size_t size() const override { return mData.size(); }
-    const std::vector<T> &getData() const { return mData; }
-
-private:
-  bool mAnswer;
-  boost::optional<unsigned> mExpected;
-  std::vector<T> mData;
-};
-
-template <class T> const std::vector<T> &BaseProblem::getData() const {
-    return dynamic_cast<const ConcreteProblem<T>&>(*this).getData();
-}
+#include <sched.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
-template <class T> void BaseProblem::init(bool answer, std::vector<T> &&data,
-                                          const boost::optional<int>& expectedValue) {
-    return dynamic_cast<const ConcreteProblem<T>&>(*this).init(answer, data, expectedValue);
-}
-
-class ProblemContainer {
-public:
-    ProblemContainer() : mProblems{ ProblemType::NB_ELEMS }, mGlobalSize{ 0 } { }
-
-  template <class T>
-  void addProblem(ProblemType type, bool answer, std::vector<T> &&data, const boost::optional<int>& expectedValue) {
-    auto prob = std::make_unique<ConcreteProblem<T>>();
-    prob->init(answer, std::move(data), expectedValue);
-    mProblems[type].push_back(std::move(prob));
-    ++mGlobalSize;
-  }
-
-  BaseProblem *getProblem(ProblemType type, int index) {
-    return mProblems[type][index].get();
-  }
-
-  size_t getProblemSize(ProblemType type) { return mProblems[type].size(); }
-
-  size_t getGlobalSize() const { return mGlobalSize; }
-
-private:
-  std::vector<std::vector<std::unique_ptr<BaseProblem>>> mProblems;
-  size_t mGlobalSize;
-};
+using boost::asio::ip::tcp;
+using boost::asio::generic::stream_protocol;
+namespace po = boost::program_options;
 
 std::atomic<int> score;
-ProblemContainer problems;
-boost::array<bool, 4> answers;
-std::atomic<int> problemScore;
+// Where the payloads of datasets are read into, when they are paged rather
+// than mapped
+std::shared_ptr<PageCache> pageCache;
+// Problems currently served, replaced as the problem sets are reloaded
+ProblemStore problemStore;
+// Fresh problems instead of the problem sets, when generating them
+std::unique_ptr<ProblemGenerator> generator;
 std::atomic<bool> expired;
 
+// Fixed seed for the problem selection, if any
+boost::optional<unsigned> seed;
+// Most batches a client may ask to have in flight at once
+unsigned maxWindow;
+// Most problems a client may ask for in a batch
+unsigned maxBatchWidth;
+// Bytes of the shared ring of a client on the same machine, 0 for none
+size_t ringSize;
+// Whether problems are compressed for the clients that ask
+bool compressPayloads;
+// Where to write the session trace on exit, if anywhere
+std::string tracePath;
+SessionTrace trace;
+LatencyTable latencies;
+Stats stats;
+// Answer deadlines of every batch, owned by the io thread, and how long
+// they are
+TimerWheel timers;
+DeadlineModel deadlines;
+
+// Server processes sharing the game and the one this process is, their
+// scores published for the process that started them to sum
+unsigned shardCount = 1;
+unsigned shardIndex = 0;
+std::unique_ptr<Scoreboard> scoreboard;
+// Whether this process started the shards rather than being one of them
+bool supervising = false;
+
 std::random_device rd;
 std::default_random_engine e1(rd());
-std::uniform_int_distribution<int> uniform_dist(0, ProblemType::NB_ELEMS - 1);
 std::uniform_int_distribution<int> uniform_dist2(0, 13);
 std::bernoulli_distribution bool_dist1(0.2);
 std::bernoulli_distribution bool_dist2(0.01);
 
+// A batch of problems sent to a client. It stays alive until it has been
+// both answered (or has expired) and completely written, as the write
+// gathers straight from its header and from the problem wire images.
+struct Batch {
+  // Problem sets the problems come from, or the problems themselves when
+  // they were generated
+  const ProblemSet *set;
+  std::unique_ptr<GeneratedBatch> generated;
+  unsigned serial;
+  unsigned type;
+  int score;
+  // Expected answers, as a bitmap
+  std::vector<uint32_t> answers;
+  std::vector<uint32_t> problems;
+  size_t elements;
+  uint64_t sentAt;
+  uint64_t writtenAt;
+  // Milliseconds from sentAt the client has to answer
+  uint64_t deadline;
+  bool outstanding;
+  bool writing;
+  size_t bytes;
+  // Pages of the page cache the buffers point into
+  std::vector<uint32_t> pages;
+  // Sequence number and problem type, the former only once negotiated,
+  // then where the problems are in the shared ring if there is one
+  boost::array<uint32_t, 4> header;
+  uint32_t ringOffset;
+  size_t ringBytes;
+  std::vector<boost::asio::const_buffer> buffers;
+  TimerNode timer;
+};
+
 class TCPConnection : public boost::enable_shared_from_this<TCPConnection> {
 public:
   typedef boost::shared_ptr<TCPConnection> pointer;
 
-  static pointer create(boost::asio::io_service &IOService) {
-    return pointer(new TCPConnection(IOService));
+  // Local connections come through a Unix domain socket, from a client on
+  // the same machine
+  static pointer create(boost::asio::io_service &IOService, unsigned id, bool local) {
+    return pointer(new TCPConnection(IOService, id, local));
   }
 
-  tcp::socket &socket() { return mSocket; }
+  stream_protocol::socket &socket() { return mSocket; }
+
+  ~TCPConnection() {
+    for (auto &batch : mPool) {
+      unpinPages(*batch);
+      problemStore.unpin(batch->set);
+    }
+    if (mStarted)
+      stats.add(SESSIONS_CLOSED);
+  }
 
   void start() {
+    mStarted = true;
+    stats.add(SESSIONS_OPENED);
+
+    // Clients that want more than the original protocol will say so in
+    // their first message, until then it is the original protocol
     sendData();
     readData();
   }
 
 private:
-  TCPConnection(boost::asio::io_service &IOService)
-      : mSocket(IOService), mTimer(IOService) {}
+  // Past this many bytes queued for a client, new batches wait
+  static const size_t MAX_QUEUED_BYTES = 4 << 20;
+  // Buffers gathered in a single write, a batch takes two per problem and
+  // one for its header, and more when its problems span several pages
+  static const size_t MAX_GATHER_BUFFERS = 320;
+  // A batch that could not be filled is tried again after this many ms
+  static const uint64_t BATCH_RETRY_MS = 5;
+
+  // Something to write that is not a batch, such as the handshake Ack
+  struct Outbound {
+    Batch *batch;
+    boost::asio::const_buffer control;
+  };
+
+  // Category and problems of a batch, drawn from the problem sets of an
+  // epoch, 0 for none
+  struct Draw {
+    uint64_t epoch = 0;
+    ProblemType type;
+    std::vector<size_t> problems;
+  };
+
+  TCPConnection(boost::asio::io_service &IOService, unsigned id, bool local)
+      : mSocket(IOService), mId(id), mLocal(local), mBatchSerial(0),
+        mStarted(false), mNegotiated(false), mFirstMessage(true), mEncoding(PLAIN_WIRE), mWidth(4), mGeneratedProblems(0), mWritesInFlight(0),
+        mQueuedBytes(0), mDeferredBatches(0), mWriting(false) {
+    // A seeded server replays the same problems on the same connection
+    std::seed_seq seq{ seed ? seed.get() : rd(), id };
+    mEngine.seed(seq);
+    mRetryTimer.callback = [this]() { sendDeferred(); };
+  }
 
   void stop() {
     mSocket.close();
-    mTimer.cancel();
+    mRetryTimer.cancel();
+    for (auto &batch : mPool)
+      batch->timer.cancel();
   }
 
   void readData() {
-    boost::asio::async_read(mSocket, boost::asio::buffer(mReadMessage),
+    // Original answers are 4 bools, negotiated ones a bitmap prefixed by
+    // the sequence number of their batch
+    size_t length = mNegotiated
+        ? sizeof(uint32_t) * (1 + answerWords(mWidth))
+        : 4;
+    boost::asio::async_read(mSocket, boost::asio::buffer(mReadMessage, length),
                             boost::bind(&TCPConnection::onDataReceived,
                                         shared_from_this(),
                                         boost::asio::placeholders::error));
   }
 
-  void onDataReceived(const boost::system::error_code &ec) {
+  bool checkReadError(const boost::system::error_code &ec) {
     if (ec) {
-        std::cout << "I f****** quit !!!" << std::endl
+        LOG_LINE(LOG_ERROR, mId) << "I f****** quit !!!";
+        LOG_LINE(LOG_ERROR, mId)
            << "Oh btw, network error, client crashed, connection reset, "
-              "armaggeddon, 9/11 or somethin'...."
-           << std::endl;
+              "armaggeddon, 9/11 or somethin'....";
       stop();
       throw std::exception();
-      return;
     }
+    return true;
+  }
 
-    bool answersAllCorrect = true;
+  void onDataReceived(const boost::system::error_code &ec) {
+    checkReadError(ec);
 
-    for (int i = 0; i < 4; ++i) {
-      if (mReadMessage[i] != answers[i]) {
-        answersAllCorrect = false;
-        break;
+    uint32_t word;
+    std::memcpy(&word, mReadMessage.data(), sizeof(word));
+    if (mFirstMessage) {
+      mFirstMessage = false;
+      if (word == HELLO_MAGIC) {
+        readHello();
+        return;
       }
     }
 
-    if (answersAllCorrect) {
-      score += problemScore * 2;
-      std::cout << "well alright... +" << problemScore * 2 << std::endl;
+    // Find the batch this answers: the oldest one not answered yet in the
+    // original protocol, as clients answer every batch in turn even when
+    // too late, the one with the sequence number otherwise
+    const char *answers = mReadMessage.data();
+    stats.add(ANSWERS_RECEIVED);
+    if (!mNegotiated) {
+      if (mUnanswered.empty()) {
+        LOG_LINE(LOG_WARN, mId) << "Answer with no batch sent, ignored";
+        readData();
+        return;
+      }
+      word = mUnanswered.front();
+      mUnanswered.pop_front();
     } else {
-      score -= problemScore;
-      std::cout << "YOU'RE WRONG !!!! -" << problemScore << std::endl;
+      answers += sizeof(word);
+    }
+
+    Batch *batch = nullptr;
+    for (auto outstanding : mOutstanding)
+      if (outstanding->serial == word)
+        batch = outstanding;
+    if (!batch) {
+      LOG_LINE(LOG_WARN, mId, word) << "Answer for a batch that is not in flight anymore, ignored";
+      stats.add(ANSWERS_LATE);
+    }
+
+    if (batch) {
+      // Bring the answers to a bitmap, ignoring the bits past the width
+      mReceived.assign(answerWords(mWidth), 0);
+      if (mNegotiated)
+        std::memcpy(mReceived.data(), answers, mReceived.size() * sizeof(uint32_t));
+      else
+        for (int i = 0; i < 4; ++i)
+          mReceived[0] |= static_cast<uint32_t>(answers[i] != 0) << i;
+      if (mWidth % 32)
+        mReceived.back() &= (1u << (mWidth % 32)) - 1;
+
+      bool answersAllCorrect = mReceived == batch->answers;
+
+      if (answersAllCorrect) {
+        score += batch->score * 2;
+        LOG_LINE(LOG_INFO, mId, batch->serial) << "well alright... +" << batch->score * 2;
+      } else {
+        score -= batch->score;
+        LOG_LINE(LOG_INFO, mId, batch->serial) << "YOU'RE WRONG !!!! -" << batch->score;
+      }
+      recordBatch(*batch, answersAllCorrect ? CORRECT : WRONG);
+      stats.add(static_cast<ProblemType>(batch->type),
+                answersAllCorrect ? BATCHES_CORRECT : BATCHES_WRONG);
+
+      // The round trip starts once the whole batch is out, or at the send if
+      // the answer beats the write completion
+      uint64_t now = trace.now();
+      uint64_t start = batch->writtenAt ? batch->writtenAt : batch->sentAt;
+      latencies.record(static_cast<ProblemType>(batch->type), batch->elements, now - start);
+      latencies.recordDeadlineUse(static_cast<ProblemType>(batch->type),
+                                  (now - batch->sentAt) / (batch->deadline * 1000));
+
+      retire(batch);
+      nextBatch();
     }
-    
-    mDataBuf.clear();
 
-    sendData();
     readData();
   }
 
-  void sendData() {
-    int next = uniform_dist(e1);
-    mDataBuf.push_back(next);
-    problemScore = next < 3 ? 2 : 1;
-    std::uniform_int_distribution<int> problemIdxDist(
-        0, problems.getProblemSize(static_cast<ProblemType>(next)) - 1);
+  void readHello() {
+    boost::asio::async_read(mSocket, boost::asio::buffer(mHelloHeader),
+                            boost::bind(&TCPConnection::onHelloHeaderReceived,
+                                        shared_from_this(),
+                                        boost::asio::placeholders::error));
+  }
 
-    std::cout << "ID: " << next << std::endl;
+  void onHelloHeaderReceived(const boost::system::error_code &ec) {
+    checkReadError(ec);
 
-    // Prepare 4 problems to send to a client
-    for (int i = 0; i < 4; ++i) {
-      auto problem = problems.getProblem(static_cast<ProblemType>(next),
-                                         problemIdxDist(e1));
+    uint32_t count = mHelloHeader[1];
+    if (count > MAX_HANDSHAKE_OPTIONS) {
+      LOG_LINE(LOG_ERROR, mId) << "Hello with " << count << " options, closing";
+      checkReadError(boost::asio::error::invalid_argument);
+    }
 
-      boost::optional<unsigned> expectedValue = problem->getExpectedValue();
-      if (expectedValue)
-        mDataBuf.push_back(expectedValue.get());
+    mHelloOptions.resize(count);
+    boost::asio::async_read(mSocket, boost::asio::buffer(mHelloOptions),
+                            boost::bind(&TCPConnection::onHelloReceived,
+                                        shared_from_this(),
+                                        boost::asio::placeholders::error));
+  }
 
-      mDataBuf.push_back(problem->size());
+  void onHelloReceived(const boost::system::error_code &ec) {
+    checkReadError(ec);
 
-      if (next < PASSWORD) {
-        auto& data = problem->getData<int>();
-        mDataBuf.insert(mDataBuf.end(), data.begin(), data.end());
-      } else {
-        auto& data = problem->getData<char>();
-        mDataBuf.insert(mDataBuf.end(), data.begin(), data.end());
-      }
-      answers[i % 4] = problem->getAnswer();
+    HandshakeOptions options = defaultHandshakeOptions();
+    for (size_t i = 0; i < std::min<size_t>(mHelloOptions.size(), NB_OPTIONS); ++i)
+      options[i] = mHelloOptions[i];
+    options[OPT_WINDOW] = std::max(1u, std::min(options[OPT_WINDOW], maxWindow));
+    options[OPT_BATCH_WIDTH] = std::max(1u, std::min(options[OPT_BATCH_WIDTH], maxBatchWidth));
+    options[OPT_SHARED_RING] = options[OPT_SHARED_RING] ? createRing() : 0;
+    options[OPT_COMPRESSION] = options[OPT_COMPRESSION] == 1 && compressPayloads;
+
+    // The batch sent before the Hello is withdrawn
+    while (!mOutstanding.empty()) {
+      Batch *batch = mOutstanding.back();
+      LOG_LINE(LOG_DEBUG, mId, batch->serial) << "Withdrawn by the handshake";
+      retire(batch);
+    }
+    mUnanswered.clear();
+
+    mNegotiated = true;
+    mWidth = options[OPT_BATCH_WIDTH];
+    uint32_t version = std::max(1u, std::min(mHelloHeader[0], PROTOCOL_VERSION));
+    bool packed = version >= PACKED_PROTOCOL_VERSION;
+    if (options[OPT_COMPRESSION])
+      mEncoding = packed ? PACKED_COMPRESSED_WIRE : COMPRESSED_WIRE;
+    else
+      mEncoding = packed ? PACKED_WIRE : PLAIN_WIRE;
+    mAckMessage[0] = ACK_MAGIC;
+    mAckMessage[1] = version;
+    mAckMessage[2] = NB_OPTIONS;
+    std::copy(options.begin(), options.end(), mAckMessage.begin() + 3);
+    queueWrite(Outbound{ nullptr, boost::asio::buffer(mAckMessage) });
+
+    LOG_LINE(LOG_INFO, mId) << "Protocol v" << mHelloHeader[0] << " requested, v" << version << " used, "
+                           << options[OPT_WINDOW] << " batches of "
+                           << mWidth << " problems in flight"
+                           << (mRing ? " through a shared ring" : "")
+                           << (options[OPT_COMPRESSION] ? ", compressed" : "");
+
+    for (unsigned i = 0; i < options[OPT_WINDOW]; ++i)
+      nextBatch();
+    readData();
+  }
+
+  // Only clients on the same machine can map the ring. Returns its key, 0
+  // when there is none.
+  uint32_t createRing() {
+    if (!mLocal || ringSize == 0)
+      return 0;
+
+    // Keys are drawn at random, one that is taken just gets skipped
+    for (int attempt = 0; attempt < 4 && !mRing; ++attempt) {
+      uint32_t key = rd();
+      if (key)
+        mRing = SharedRing::create(key, ringSize);
     }
+    if (!mRing)
+      LOG_LINE(LOG_WARN, mId) << "Could not create a shared ring, batches go on the socket";
+    return mRing ? mRing->getKey() : 0;
+  }
+
+  // False when the batch could not be filled, it is then deferred and
+  // tried again shortly
+  bool sendData() {
+    Batch &batch = acquireBatch();
+    if (!(generator ? fillGenerated(batch) : fillFromSets(batch))) {
+      mFree.push_back(&batch);
+      ++mDeferredBatches;
+      if (!mRetryTimer.armed())
+        timers.arm(mRetryTimer, BATCH_RETRY_MS);
+      return false;
+    }
+    if (mRing)
+      placeInRing(batch);
+    batch.bytes = boost::asio::buffer_size(batch.buffers);
+    batch.sentAt = trace.now();
+    batch.writtenAt = 0;
+    batch.outstanding = true;
+    mOutstanding.push_back(&batch);
+    if (!mNegotiated)
+      mUnanswered.push_back(batch.serial);
+
+    LOG_LINE(LOG_DEBUG, mId, batch.serial) << "ID: " << batch.type;
 
     // Send the problems to a client
-    boost::asio::async_write(
-        mSocket, boost::asio::buffer(mDataBuf, mDataBuf.size() * sizeof(unsigned)),
-        boost::bind(&TCPConnection::handleWrite, shared_from_this(),
-            boost::asio::placeholders::error,
-            boost::asio::placeholders::bytes_transferred));
+    queueWrite(Outbound{ &batch, boost::asio::const_buffer() });
 
-    // Wait 5 seconds at most for an answer, before sending the next batch of problems
-    mTimer.expires_from_now(boost::posix_time::seconds(5));
-    mTimer.async_wait(boost::bind(&TCPConnection::onDataTimerExpired,
-        shared_from_this(),
-        boost::asio::placeholders::error, &mTimer));
+    // Wait for an answer as long as the size of the batch warrants, before
+    // sending the next batch of problems
+    batch.deadline = deadlines.deadlineOf(static_cast<ProblemType>(batch.type), batch.elements);
+    timers.arm(batch.timer, batch.deadline);
+    return true;
   }
 
-  void onDataTimerExpired(const boost::system::error_code &ec,
-                          boost::asio::deadline_timer * deadline) {
-    if (!ec && (deadline->expires_at() <= boost::asio::deadline_timer::traits_type::now())) {
-        std::cout << "Awww.... too slow -" << problemScore << std::endl;
-        score -= problemScore;
-        mDataBuf.clear();
-        sendData();
+  // Numbers the batch and lays its header in the first of `buffers` buffers
+  void startBatch(Batch &batch, ProblemType next, size_t buffers) {
+    batch.serial = ++mBatchSerial;
+    batch.type = next;
+    batch.score = next < 3 ? 2 : 1;
+    stats.add(next, BATCHES_SENT);
+
+    batch.buffers.resize(buffers);
+    batch.problems.resize(mWidth);
+    batch.answers.assign(answerWords(mWidth), 0);
+    batch.header[0] = batch.serial;
+    batch.header[1] = next;
+    batch.header[2] = NO_RING_OFFSET;
+    batch.header[3] = 0;
+    batch.ringOffset = NO_RING_OFFSET;
+    batch.ringBytes = 0;
+    batch.buffers[0] = mNegotiated
+        ? boost::asio::buffer(batch.header.data(), (mRing ? 4 : 2) * sizeof(uint32_t))
+        : boost::asio::buffer(&batch.header[1], sizeof(uint32_t));
+  }
+
+  // Copies the problems to the shared ring, so only the header goes on the
+  // socket. When the ring is full, they go on the socket after it.
+  void placeInRing(Batch &batch) {
+    size_t bytes = boost::asio::buffer_size(batch.buffers) - boost::asio::buffer_size(batch.buffers[0]);
+    uint32_t offset;
+    if (!mRing->allocate(bytes, batch.serial, offset)) {
+      LOG_LINE(LOG_DEBUG, mId, batch.serial) << "Shared ring full, batch sent on the socket";
+      return;
     }
+
+    char *out = mRing->data() + offset;
+    for (size_t i = 1; i < batch.buffers.size(); ++i) {
+      size_t size = boost::asio::buffer_size(batch.buffers[i]);
+      std::memcpy(out, boost::asio::buffer_cast<const void *>(batch.buffers[i]), size);
+      out += size;
+    }
+    batch.header[2] = batch.ringOffset = offset;
+    batch.header[3] = static_cast<uint32_t>(bytes);
+    batch.ringBytes = bytes;
+    batch.buffers.resize(1);
+    unpinPages(batch);
+  }
+
+  // Draws the category and the problems of a batch
+  void drawProblems(const ProblemSet &set, Draw &draw) {
+    draw.epoch = set.epoch;
+    draw.type = set.sampler.sampleCategory(mEngine);
+    draw.problems.resize(mWidth);
+    for (auto &index : draw.problems)
+      index = set.sampler.sampleProblem(draw.type, mEngine);
   }
 
-  void handleWrite(const boost::system::error_code & /*error*/,
-                   size_t /*bytes_transferred*/) {
-      mDataBuf.clear();
-      std::cout << "You have " << score << " points, new problem sent" << std::endl;
+  // False when a page of the problems could not be read, the batch is
+  // then drawn again
+  bool fillFromSets(Batch &batch) {
+    // The batch keeps the problem sets pinned until it is released
+    const ProblemSet *set = problemStore.pin();
+    batch.set = set;
+    if (mNextDraw.epoch != set->epoch || mNextDraw.problems.size() != mWidth)
+      drawProblems(*set, mNextDraw);
+    ProblemType next = mNextDraw.type;
+    // Gather the pre-encoded images of the problems after room for the
+    // header, which is only numbered once they are all read
+    auto &arena = set->problems.getArena(next);
+    batch.buffers.resize(1);
+    for (size_t index : mNextDraw.problems) {
+      batch.buffers.push_back(arena.getWireHeader(mEncoding, index));
+      if (!arena.appendPayload(mEncoding, index, batch.buffers, batch.pages)) {
+        LOG_LINE(LOG_WARN, mId) << "A page of the problem sets could not be read, batch drawn again";
+        unpinPages(batch);
+        problemStore.unpin(set);
+        batch.set = nullptr;
+        mNextDraw.epoch = 0;
+        return false;
+      }
+    }
+    startBatch(batch, next, batch.buffers.size());
+    batch.elements = 0;
+    for (unsigned i = 0; i < mWidth; ++i) {
+      size_t index = mNextDraw.problems[i];
+      batch.answers[i / 32] |= static_cast<uint32_t>(arena.getAnswer(index)) << (i % 32);
+      batch.problems[i] = index;
+      batch.elements += arena.getLength(index);
+    }
+
+    // Paged problems of the next batch are read ahead while this one is out
+    mNextDraw.epoch = 0;
+    if (set->problems.isPaged()) {
+      drawProblems(*set, mNextDraw);
+      auto &nextArena = set->problems.getArena(mNextDraw.type);
+      for (size_t index : mNextDraw.problems)
+        nextArena.prefetch(mEncoding, index);
+    }
+    return true;
+  }
+
+  void unpinPages(Batch &batch) {
+    for (uint32_t slot : batch.pages)
+      pageCache->unpin(slot);
+    batch.pages.clear();
+  }
+
+  // Generated problems are already laid out for the wire, one buffer holds
+  // them all. They are not part of any problem set, so the trace numbers
+  // them in the order they were sent. False when no batch is ready yet.
+  bool fillGenerated(Batch &batch) {
+    batch.generated = generator->take(mWidth);
+    if (!batch.generated)
+      return false;
+    const GeneratedBatch &generated = *batch.generated;
+    startBatch(batch, generated.type, 2);
+    batch.buffers[1] = mEncoding == PLAIN_WIRE
+        ? boost::asio::buffer(generated.wire)
+        : boost::asio::buffer(generated.encodedWire[mEncoding]);
+    batch.answers = generated.answers;
+    for (unsigned i = 0; i < mWidth; ++i)
+      batch.problems[i] = mGeneratedProblems++;
+    batch.elements = generated.elements;
+    return true;
+  }
+
+  void onDataTimerExpired(Batch *batch) {
+    if (batch->outstanding) {
+        LOG_LINE(LOG_INFO, mId, batch->serial) << "Awww.... too slow -" << batch->score
+                                              << " (" << batch->deadline << " ms for "
+                                              << batch->elements << " elements)";
+        score -= batch->score;
+        recordBatch(*batch, TIMEOUT);
+        latencies.recordTimeout(static_cast<ProblemType>(batch->type), batch->elements);
+        stats.add(static_cast<ProblemType>(batch->type), BATCHES_TIMED_OUT);
+        retire(batch);
+        nextBatch();
+    }
+  }
+
+  // A client that stopped reading does not get more batches piled up, the
+  // next one waits for the queued ones to be written
+  void nextBatch() {
+    if (mQueuedBytes >= MAX_QUEUED_BYTES) {
+      ++mDeferredBatches;
+      LOG_LINE(LOG_DEBUG, mId) << mQueuedBytes << " bytes not read by the client yet, next batch deferred";
+      return;
+    }
+    sendData();
+  }
+
+  // Writes go out in the order they were queued, one at a time as
+  // concurrent writes on a socket may interleave. Whatever was queued while
+  // a write was in flight goes out together in the next one.
+  void queueWrite(const Outbound &outbound) {
+    if (outbound.batch) {
+      outbound.batch->writing = true;
+      mQueuedBytes += outbound.batch->bytes;
+    } else {
+      mQueuedBytes += boost::asio::buffer_size(outbound.control);
+    }
+    mWriteQueue.push_back(outbound);
+    if (!mWriting)
+      writeNext();
+  }
+
+  void writeNext() {
+    mWriting = !mWriteQueue.empty();
+    if (!mWriting)
+      return;
+
+    mGather.clear();
+    for (mWritesInFlight = 0; mWritesInFlight < mWriteQueue.size() &&
+                              mGather.size() < MAX_GATHER_BUFFERS;
+         ++mWritesInFlight) {
+      const Outbound &outbound = mWriteQueue[mWritesInFlight];
+      if (outbound.batch)
+        mGather.insert(mGather.end(), outbound.batch->buffers.begin(),
+                       outbound.batch->buffers.end());
+      else
+        mGather.push_back(outbound.control);
+    }
+
+    boost::asio::async_write(mSocket, mGather,
+                             boost::bind(&TCPConnection::handleWrite, shared_from_this(),
+                                         boost::asio::placeholders::error,
+                                         boost::asio::placeholders::bytes_transferred));
+  }
+
+  void handleWrite(const boost::system::error_code &error,
+                   size_t bytes_transferred) {
+      mQueuedBytes -= bytes_transferred;
+      mWriting = false;
+
+      // The batches of this write are not referred to by the socket anymore
+      uint64_t writtenAt = trace.now();
+      for (size_t i = 0; i < mWritesInFlight; ++i) {
+        Outbound outbound = mWriteQueue.front();
+        mWriteQueue.pop_front();
+
+        if (Batch *batch = outbound.batch) {
+          if (!error)
+            stats.add(static_cast<ProblemType>(batch->type), BYTES_SENT,
+                      batch->bytes + batch->ringBytes);
+          batch->writing = false;
+          if (batch->outstanding)
+            batch->writtenAt = writtenAt;
+          LOG_LINE(LOG_DEBUG, mId, batch->serial) << "You have " << score << " points, new problem sent";
+          release(batch);
+        }
+      }
+      mWritesInFlight = 0;
+
+      // A broken connection is reported by the pending read
+      if (error)
+        return;
+
+      sendDeferred();
+      if (!mWriting)
+        writeNext();
+  }
+
+  // Sends the deferred batches there is room for, until one cannot be
+  // filled yet
+  void sendDeferred() {
+    while (mDeferredBatches > 0 && mQueuedBytes < MAX_QUEUED_BYTES) {
+      --mDeferredBatches;
+      if (!sendData())
+        break;
+    }
+  }
+
+  Batch &acquireBatch() {
+    if (mFree.empty()) {
+      mPool.emplace_back(new Batch);
+      Batch *batch = mPool.back().get();
+      batch->set = nullptr;
+      batch->ringOffset = NO_RING_OFFSET;
+      // The pool lives as long as the connection and a batch cancels its
+      // timer when destroyed, so the wheel never calls into a dead one
+      batch->timer.callback = [this, batch]() { onDataTimerExpired(batch); };
+      mFree.push_back(batch);
+    }
+    Batch *batch = mFree.back();
+    mFree.pop_back();
+    return *batch;
+  }
+
+  // The batch is not waiting for an answer anymore
+  void retire(Batch *batch) {
+    batch->outstanding = false;
+    batch->timer.cancel();
+    mOutstanding.erase(std::find(mOutstanding.begin(), mOutstanding.end(), batch));
+    release(batch);
+  }
+
+  // Back to the free list once nothing refers to the batch anymore
+  void release(Batch *batch) {
+    if (!batch->outstanding && !batch->writing) {
+      unpinPages(*batch);
+      problemStore.unpin(batch->set);
+      batch->set = nullptr;
+      batch->generated.reset();
+      if (batch->ringOffset != NO_RING_OFFSET)
+        mRing->release(batch->ringOffset);
+      batch->ringOffset = NO_RING_OFFSET;
+      mFree.push_back(batch);
+    }
+  }
+
+  void recordBatch(const Batch &batch, BatchOutcome outcome) {
+    if (tracePath.empty())
+      return;
+
+    BatchRecord record;
+    record.connection = mId;
+    record.category = batch.type;
+    record.outcome = outcome;
+    record.problems = batch.problems;
+    record.sentAt = batch.sentAt;
+    record.answeredAt = outcome == TIMEOUT ? 0 : trace.now();
+    trace.record(std::move(record));
   }
 
 private:
-  tcp::socket mSocket;
-  boost::array<bool, 4> mReadMessage;
-  boost::asio::deadline_timer mTimer;
-  std::vector<unsigned> mDataBuf;
+  stream_protocol::socket mSocket;
+  unsigned mId;
+  bool mLocal;
+  // Where the batches go when the client asked for a shared ring
+  std::unique_ptr<SharedRing> mRing;
+  std::default_random_engine mEngine;
+  unsigned mBatchSerial;
+  bool mStarted;
+  bool mNegotiated;
+  bool mFirstMessage;
+  WireEncoding mEncoding;
+  // Problems per batch
+  unsigned mWidth;
+  // The next batch, drawn ahead of time from paged problem sets
+  Draw mNextDraw;
+  // Generated problems sent so far, numbered for the trace
+  uint32_t mGeneratedProblems;
+
+  boost::array<char, sizeof(uint32_t) * (1 + MAX_BATCH_WIDTH / 32)> mReadMessage;
+  std::vector<uint32_t> mReceived;
+  boost::array<uint32_t, 2> mHelloHeader;
+  std::vector<uint32_t> mHelloOptions;
+  boost::array<uint32_t, 3 + NB_OPTIONS> mAckMessage;
+
+  // Every batch ever needed on this connection, those not in use are free
+  std::vector<std::unique_ptr<Batch>> mPool;
+  std::vector<Batch *> mFree;
+  std::vector<Batch *> mOutstanding;
+
+  // Serials of the batches sent the original way the client has not
+  // answered yet, expired ones included
+  std::deque<unsigned> mUnanswered;
+
+  std::deque<Outbound> mWriteQueue;
+  std::vector<boost::asio::const_buffer> mGather;
+  size_t mWritesInFlight;
+  size_t mQueuedBytes;
+  unsigned mDeferredBatches;
+  bool mWriting;
+  // Sends the deferred batches again after one could not be filled
+  TimerNode mRetryTimer;
 };
 
+// Accepts clients on a TCP port or a Unix domain socket. Connection ids
+// are shared by every listener so they stay unique in the logs and traces,
+// and interleaved between shards so they are unique across them too. The
+// shards all listen on the same TCP port, the kernel spreads the incoming
+// connections between them.
 class TCPServer {
 public:
-  TCPServer(boost::asio::io_service &IOService)
-      : mAcceptor(IOService, tcp::endpoint(tcp::v4(), 22022)) {
+  TCPServer(boost::asio::io_service &IOService, const stream_protocol::endpoint &endpoint,
+            bool local)
+      : mIOService(IOService), mAcceptor(IOService), mLocal(local) {
+    typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port;
+
+    mAcceptor.open(endpoint.protocol());
+    mAcceptor.set_option(boost::asio::socket_base::reuse_address(true));
+    if (shardCount > 1 && !local)
+      mAcceptor.set_option(reuse_port(true));
+    mAcceptor.bind(endpoint);
+    mAcceptor.listen();
     startAccept();
   }
 
 private:
   void startAccept() {
     TCPConnection::pointer NewConnection =
-        TCPConnection::create(mAcceptor.get_io_service());
+        TCPConnection::create(mIOService, mNextId++ * shardCount + shardIndex, mLocal);
 
     mAcceptor.async_accept(NewConnection->socket(),
                            boost::bind(&TCPServer::handleAccept, this,
@@ -271,7 +776,7 @@ private:
   void handleAccept(TCPConnection::pointer NewConnection,
                     const boost::system::error_code &error) {
     if (!error) {
-      std::cout << "Here we go !" << std::endl;
+      LOG_LINE(LOG_INFO) << "Here we go !";
       NewConnection->start();
     }
 
@@ -279,76 +784,750 @@ private:
   }
 
 private:
+  boost::asio::io_service &mIOService;
+  boost::asio::basic_socket_acceptor<stream_protocol> mAcceptor;
+  bool mLocal;
+  static unsigned mNextId;
+};
+
+unsigned TCPServer::mNextId = 0;
+
+// Counters to report. The process that started the shards serves none
+// itself: its score and latencies are brought up to date with theirs first.
+StatsSnapshot takeSnapshot() {
+  if (!supervising)
+    return stats.snapshot();
+  score = scoreboard->getScore();
+  scoreboard->collectLatencies(latencies);
+  return scoreboard->snapshot();
+}
+
+// Answers a single request for a snapshot of the stats, then hangs up. The
+// request is either an HTTP GET of / (text) or /json, or a bare line saying
+// text or json.
+class StatsSession : public boost::enable_shared_from_this<StatsSession> {
+public:
+  typedef boost::shared_ptr<StatsSession> pointer;
+
+  static pointer create(boost::asio::io_service &IOService) {
+    return pointer(new StatsSession(IOService));
+  }
+
+  tcp::socket &socket() { return mSocket; }
+
+  void start() {
+    boost::asio::async_read_until(mSocket, mRequest, '\n',
+                                  boost::bind(&StatsSession::onRequestLine,
+                                              shared_from_this(),
+                                              boost::asio::placeholders::error));
+  }
+
+private:
+  explicit StatsSession(boost::asio::io_service &IOService)
+      : mSocket(IOService), mRequest(4096), mHttp(false) {}
+
+  void onRequestLine(const boost::system::error_code &ec) {
+    if (ec)
+      return;
+
+    std::istream in(&mRequest);
+    std::string line;
+    std::getline(in, line);
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+
+    // HTTP clients get their answer once they are done with the headers
+    std::string what = line;
+    if (line.compare(0, 4, "GET ") == 0) {
+      what = line.substr(4, line.find(' ', 4) - 4);
+      mHttp = true;
+      boost::asio::async_read_until(mSocket, mRequest, "\r\n\r\n",
+                                    boost::bind(&StatsSession::respond,
+                                                shared_from_this(), what,
+                                                boost::asio::placeholders::error));
+      return;
+    }
+    respond(what, boost::system::error_code());
+  }
+
+  void respond(const std::string &what, const boost::system::error_code &ec) {
+    // Headers may already have been read with the request line
+    if (ec && ec != boost::asio::error::not_found)
+      return;
+
+    bool json = what == "json" || what == "/json";
+    StatsSnapshot snapshot = takeSnapshot();
+    std::ostringstream body;
+    if (json)
+      writeStatsJson(body, snapshot, score, latencies, pageCache.get());
+    else
+      writeStatsText(body, snapshot, score, latencies, pageCache.get());
+
+    std::ostringstream response;
+    if (mHttp)
+      response << "HTTP/1.0 200 OK\r\nContent-Type: "
+               << (json ? "application/json" : "text/plain")
+               << "\r\nContent-Length: " << body.str().size()
+               << "\r\nConnection: close\r\n\r\n";
+    response << body.str();
+    mResponse = response.str();
+
+    boost::asio::async_write(mSocket, boost::asio::buffer(mResponse),
+                             boost::bind(&StatsSession::onResponseWritten,
+                                         shared_from_this(),
+                                         boost::asio::placeholders::error));
+  }
+
+  void onResponseWritten(const boost::system::error_code &) {
+    boost::system::error_code ignored;
+    mSocket.shutdown(tcp::socket::shutdown_both, ignored);
+  }
+
+private:
+  tcp::socket mSocket;
+  boost::asio::streambuf mRequest;
+  std::string mResponse;
+  bool mHttp;
+};
+
+// Serves stats snapshots on a local port, next to the game
+class StatsServer {
+public:
+  // Null if the port cannot be bound, which leaves the game running
+  // without stats
+  static std::unique_ptr<StatsServer> start(boost::asio::io_service &IOService,
+                                            unsigned short port) {
+    try {
+      return std::unique_ptr<StatsServer>(new StatsServer(IOService, port));
+    } catch (const boost::system::system_error &e) {
+      std::cerr << "Could not serve stats on port " << port << ": " << e.what()
+                << ", going on without them" << std::endl;
+      return nullptr;
+    }
+  }
+
+private:
+  StatsServer(boost::asio::io_service &IOService, unsigned short port)
+      : mIOService(IOService),
+        mAcceptor(IOService, tcp::endpoint(boost::asio::ip::address_v4::loopback(), port)) {
+    startAccept();
+  }
+
+  void startAccept() {
+    StatsSession::pointer session = StatsSession::create(mIOService);
+    mAcceptor.async_accept(session->socket(),
+                           boost::bind(&StatsServer::handleAccept, this, session,
+                                       boost::asio::placeholders::error));
+  }
+
+  void handleAccept(StatsSession::pointer session,
+                    const boost::system::error_code &error) {
+    if (!error)
+      session->start();
+    startAccept();
+  }
+
+private:
+  boost::asio::io_service &mIOService;
   tcp::acceptor mAcceptor;
 };
 
-template <class T>
-void readProblem(const std::string &name, ProblemType type, ProblemContainer &problems) {
-  std::ifstream file(name, std::ios::in | std::ios::binary);
-
-  file.seekg(0, file.end);
-  int length = file.tellg();
-  file.seekg(0, file.beg);
-  T tempDataType;
-  int tempInt;
-  int size;
-  boost::optional<int> expectedValue = boost::none;
-
-  // Read problem set
-  while (length > 0) {
-    // Read the flag
-    unsigned char flag = file.get();
-    --length;
-
-    // Read the expected value if this is a RLE problem
-    if (type == RLE) {
-        file.read((char *)&tempInt, sizeof(tempInt));
-        length -= sizeof(tempInt);
-        expectedValue = tempInt;
-    }
-
-    // Read the 4 problems
-    for (int i = 0; i < 4; ++i) {
-      // Read single problem size
-      file.read((char *)&tempInt, sizeof(tempInt));
-      length -= sizeof(tempInt);
-      size = tempInt;
-
-      // Read the expected value if this is an array problem
-      if (type == ARRAY) {
-        file.read((char *)&tempInt, sizeof(tempInt));
-        length -= sizeof(tempInt);
-        expectedValue = tempInt;
-        --size;
-      }
+// Advances the timer wheel of the io thread it runs on every millisecond
+class TimerWheelTicker {
+public:
+  TimerWheelTicker(boost::asio::io_service &IOService, TimerWheel &wheel)
+      : mTimer(IOService), mWheel(wheel) {
+    mTimer.expires_from_now(std::chrono::milliseconds(1));
+    schedule();
+  }
 
-      // Read the problem data
-      std::vector<T> problemData;
-      problemData.reserve(tempInt);
-      for (int j = 0; j < size; ++j) {
-        file.read((char *)&tempDataType, sizeof(tempDataType));
-        length -= sizeof(tempDataType);
-        problemData.push_back(tempDataType);
-      }
-      problems.addProblem(type, flag & (1 << i), std::move(problemData), expectedValue);
+private:
+  void schedule() {
+    mTimer.async_wait(boost::bind(&TimerWheelTicker::onTick, this,
+                                  boost::asio::placeholders::error));
+  }
+
+  void onTick(const boost::system::error_code &ec) {
+    if (ec)
+      return;
+    mWheel.advance();
+    // Tick on the same cadence however long the callbacks took
+    mTimer.expires_at(mTimer.expires_at() + std::chrono::milliseconds(1));
+    schedule();
+  }
+
+private:
+  boost::asio::steady_timer mTimer;
+  TimerWheel &mWheel;
+};
+
+// Prints the round trip latencies at a fixed interval
+class LatencyReporter {
+public:
+  LatencyReporter(boost::asio::io_service &IOService, unsigned seconds)
+      : mTimer(IOService), mInterval(seconds) {
+    if (seconds > 0)
+      schedule();
+  }
+
+private:
+  void schedule() {
+    mTimer.expires_from_now(mInterval);
+    mTimer.async_wait(boost::bind(&LatencyReporter::onTimerExpired, this,
+                                  boost::asio::placeholders::error));
+  }
+
+  void onTimerExpired(const boost::system::error_code &ec) {
+    if (ec)
+      return;
+    takeSnapshot();
+    std::istringstream report([] {
+      std::ostringstream out;
+      latencies.print(out);
+      if (pageCache)
+        pageCache->print(out);
+      return out.str();
+    }());
+    for (std::string line; std::getline(report, line);)
+      LOG_LINE(LOG_INFO) << line;
+    schedule();
+  }
+
+private:
+  boost::asio::deadline_timer mTimer;
+  boost::posix_time::seconds mInterval;
+};
+
+// Publishes the score, counters and latencies of a shard to the scoreboard
+// a few times a second
+class ShardPublisher {
+public:
+  explicit ShardPublisher(boost::asio::io_service &IOService) : mTimer(IOService) {
+    schedule();
+  }
+
+  ~ShardPublisher() { publish(); }
+
+private:
+  void schedule() {
+    mTimer.expires_from_now(std::chrono::milliseconds(100));
+    mTimer.async_wait(boost::bind(&ShardPublisher::onTimerExpired, this,
+                                  boost::asio::placeholders::error));
+  }
+
+  void onTimerExpired(const boost::system::error_code &ec) {
+    if (ec)
+      return;
+    publish();
+    schedule();
+  }
+
+  void publish() { scoreboard->publish(shardIndex, score, stats.snapshot(), latencies); }
+
+private:
+  boost::asio::steady_timer mTimer;
+};
+
+// Loads the 6 problem sets side by side and prepares to draw from them.
+// Returns null if the sampler is left with nothing to draw.
+std::unique_ptr<ProblemSet> loadProblemSets(const std::vector<std::string> &sets,
+                                            const SamplerConfig &config,
+                                            std::ostream &report) {
+  // Problem sets in the order they are given on the command line
+  const ProblemType setTypes[] = { MAZE, SUDOKU, ARRAY, PASSWORD, TREE, RLE };
+
+  std::unique_ptr<ProblemSet> set(new ProblemSet);
+  auto loadStart = std::chrono::steady_clock::now();
+  boost::array<LoadStats, ProblemType::NB_ELEMS> loadStats;
+  std::vector<std::thread> loaders;
+  for (size_t i = 0; i < sets.size(); ++i) {
+    loaders.emplace_back([&, i] {
+      loadStats[setTypes[i]] = readProblem(sets[i], setTypes[i], set->problems, compressPayloads,
+                                           shardIndex, shardCount, pageCache.get());
+    });
+  }
+  for (auto &loader : loaders)
+    loader.join();
+
+  LoadStats total{ "total", 0, 0, std::chrono::duration<double, std::milli>(
+                                      std::chrono::steady_clock::now() - loadStart).count(),
+                   0, 0, 0, 0, 0, 0, 0. };
+  for (auto &stats : loadStats) {
+    printLoadStats(stats, report);
+    total.problems += stats.problems;
+    total.bytes += stats.bytes;
+    total.duplicates += stats.duplicates;
+    total.savedBytes += stats.savedBytes;
+    total.distinctBytes += stats.distinctBytes;
+    total.packedBytes += stats.packedBytes;
+    total.compressedBytes += stats.compressedBytes;
+    total.packedCompressedBytes += stats.packedCompressedBytes;
+    total.decodeMilliseconds += stats.decodeMilliseconds;
+  }
+  printLoadStats(total, report);
+
+  report << set->problems.getGlobalSize() << " problems loaded" << std::endl;
+
+  if (!set->sampler.build(set->problems, config))
+    return nullptr;
+  return set;
+}
+
+// Reloads the problem sets in the background on SIGHUP, or once their files
+// have changed and then been left alone for a second. Connections keep
+// serving from the sets they have pinned and move to the new ones with
+// their next batch.
+class ProblemSetReloader {
+public:
+  ProblemSetReloader(boost::asio::io_service &IOService,
+                     const std::vector<std::string> &sets,
+                     const SamplerConfig &config)
+      : mSignals(IOService, SIGHUP), mTimer(IOService), mSets(sets),
+        mConfig(config), mLoading(false) {
+    mLoaded = mSeen = stampFiles();
+    waitForSignal();
+    schedulePoll();
+  }
+
+  ~ProblemSetReloader() {
+    if (mLoader.joinable())
+      mLoader.join();
+  }
+
+private:
+  // Modification time and size of every file
+  typedef std::vector<std::pair<int64_t, int64_t>> Stamps;
+
+  Stamps stampFiles() const {
+    Stamps stamps;
+    for (auto &name : mSets) {
+      struct stat info;
+      if (::stat(name.c_str(), &info) == 0)
+        stamps.emplace_back(info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec,
+                            info.st_size);
+      else
+        stamps.emplace_back(-1, -1);
     }
+    return stamps;
   }
+
+  void waitForSignal() {
+    mSignals.async_wait([this](const boost::system::error_code &ec, int) {
+      if (ec)
+        return;
+      LOG_LINE(LOG_INFO) << "SIGHUP, reloading the problem sets";
+      reload();
+      waitForSignal();
+    });
+  }
+
+  void schedulePoll() {
+    mTimer.expires_from_now(boost::posix_time::seconds(1));
+    mTimer.async_wait(boost::bind(&ProblemSetReloader::onPoll, this,
+                                  boost::asio::placeholders::error));
+  }
+
+  void onPoll(const boost::system::error_code &ec) {
+    if (ec)
+      return;
+
+    if (size_t retired = problemStore.reclaim())
+      LOG_LINE(LOG_DEBUG) << retired << " old problem sets still in use";
+
+    Stamps stamps = stampFiles();
+    if (stamps != mLoaded && stamps == mSeen) {
+      LOG_LINE(LOG_INFO) << "Problem sets changed, reloading";
+      reload();
+    }
+    mSeen = stamps;
+    schedulePoll();
+  }
+
+  void reload() {
+    if (mLoading)
+      return;
+    if (mLoader.joinable())
+      mLoader.join();
+
+    mLoading = true;
+    mLoaded = stampFiles();
+    mLoader = std::thread([this] {
+      std::ostringstream report;
+      std::unique_ptr<ProblemSet> set = loadProblemSets(mSets, mConfig, report);
+
+      std::istringstream lines(report.str());
+      for (std::string line; std::getline(lines, line);)
+        LOG_LINE(LOG_INFO) << line;
+      if (set)
+        problemStore.publish(std::move(set));
+      else
+        LOG_LINE(LOG_WARN) << "No problems to send from the new sets, keeping the old ones";
+      mLoading = false;
+    });
+  }
+
+private:
+  boost::asio::signal_set mSignals;
+  boost::asio::deadline_timer mTimer;
+  std::vector<std::string> mSets;
+  SamplerConfig mConfig;
+  Stamps mLoaded;
+  Stamps mSeen;
+  std::atomic<bool> mLoading;
+  std::thread mLoader;
+};
+
+// Watches the shards forked by main, passing on the signals it gets, and
+// stops once they have all exited. As with a single process, the game ends
+// with the first client to leave: the first shard to exit takes the others
+// down with it. Shards are only asked to stop once, as a second signal could
+// catch one after it stopped listening for them and before it reported.
+class ShardSupervisor {
+public:
+  ShardSupervisor(boost::asio::io_service &IOService, const std::vector<pid_t> &shards)
+      : mIOService(IOService), mExits(IOService, SIGCHLD),
+        mSignals(IOService, SIGINT, SIGTERM, SIGHUP), mShards(shards),
+        mRunning(shards.size()), mStopping(false) {
+    waitForExits();
+    waitForSignals();
+    // Shards may have exited before anyone was listening
+    reap();
+  }
+
+private:
+  void waitForExits() {
+    mExits.async_wait([this](const boost::system::error_code &ec, int) {
+      if (ec)
+        return;
+      reap();
+      waitForExits();
+    });
+  }
+
+  void waitForSignals() {
+    mSignals.async_wait([this](const boost::system::error_code &ec, int signal) {
+      if (ec)
+        return;
+      // Reloading is up to each shard, anything else stops them
+      if (signal == SIGHUP)
+        signalShards(SIGHUP);
+      else
+        stopShards();
+      waitForSignals();
+    });
+  }
+
+  void signalShards(int signal) {
+    for (pid_t pid : mShards)
+      if (pid > 0)
+        ::kill(pid, signal);
+  }
+
+  void stopShards() {
+    if (!mStopping)
+      signalShards(SIGTERM);
+    mStopping = true;
+  }
+
+  void reap() {
+    int status;
+    pid_t pid;
+    while ((pid = ::waitpid(-1, &status, WNOHANG)) > 0) {
+      auto shard = std::find(mShards.begin(), mShards.end(), pid);
+      if (shard == mShards.end())
+        continue;
+      *shard = 0;
+
+      unsigned index = static_cast<unsigned>(shard - mShards.begin());
+      LOG_LINE(LOG_INFO) << "Shard " << index << " exited, score " << scoreboard->getScore(index);
+      if (--mRunning == 0)
+        mIOService.stop();
+      else
+        stopShards();
+    }
+  }
+
+private:
+  boost::asio::io_service &mIOService;
+  boost::asio::signal_set mExits;
+  boost::asio::signal_set mSignals;
+  std::vector<pid_t> mShards;
+  size_t mRunning;
+  bool mStopping;
+};
+
+// Pins a shard, and the threads it will start, to its share of the cores
+// the server may run on. Returns the cores it got.
+std::string pinShard(unsigned shard, unsigned shards) {
+  cpu_set_t allowed;
+  if (::sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    return "every core";
+  std::vector<int> cores;
+  for (int core = 0; core < CPU_SETSIZE; ++core)
+    if (CPU_ISSET(core, &allowed))
+      cores.push_back(core);
+
+  // Shards share the cores when there are fewer cores than shards
+  size_t first = shard * cores.size() / shards;
+  size_t last = std::max(first + 1, (shard + 1) * cores.size() / shards);
+  if (cores.size() < shards)
+    first = shard % cores.size(), last = first + 1;
+
+  cpu_set_t mine;
+  CPU_ZERO(&mine);
+  std::ostringstream description;
+  for (size_t i = first; i < last; ++i) {
+    CPU_SET(cores[i], &mine);
+    description << (i > first ? "," : "") << cores[i];
+  }
+  if (::sched_setaffinity(0, sizeof(mine), &mine) != 0)
+    return "every core";
+  return "cores " + description.str();
+}
+
+// Whether the Unix socket can be bound at `path`: nothing is there, or a
+// socket file left behind by a server that is gone, which refuses
+// connections and is removed. A server still listening there keeps it.
+bool claimUnixSocket(const std::string &path) {
+  boost::asio::io_service IOService;
+  boost::asio::local::stream_protocol::socket probe(IOService);
+  boost::system::error_code error;
+  probe.connect(boost::asio::local::stream_protocol::endpoint(path), error);
+  if (error == boost::system::errc::no_such_file_or_directory)
+    return true;
+
+  struct stat info;
+  if (error == boost::asio::error::connection_refused && ::lstat(path.c_str(), &info) == 0 &&
+      S_ISSOCK(info.st_mode)) {
+    std::remove(path.c_str());
+    return true;
+  }
+
+  std::cerr << "Not listening on " << path << ": "
+            << (error ? error.message() : "another server is listening there") << std::endl;
+  return false;
+}
+
+// Runs the process that started the shards: it serves the stats of the
+// whole game and reports on it once every shard is gone
+int superviseShards(const std::vector<pid_t> &shards, unsigned short statsPort,
+                    unsigned statsInterval, LogLevel logLevel) {
+  supervising = true;
+  try {
+    boost::asio::io_service IOService;
+    ShardSupervisor Supervisor(IOService, shards);
+    LatencyReporter Reporter(IOService, statsInterval);
+    std::unique_ptr<StatsServer> StatsEndpoint;
+    if (statsPort)
+      StatsEndpoint = StatsServer::start(IOService, statsPort);
+
+    std::cout << "Waiting for clients on " << shards.size() << " shards..." << std::endl;
+    logger.start(logLevel);
+    IOService.run();
+  } catch (std::exception &e) {
+    std::cerr << e.what() << std::endl;
+  }
+  logger.stop();
+
+  takeSnapshot();
+  for (unsigned shard = 0; shard < shards.size(); ++shard)
+    std::cout << "Shard " << shard << " score " << scoreboard->getScore(shard) << std::endl;
+  latencies.print(std::cout);
+  for (int i = 0; i < 5; ++i)
+      std::cout << "FINAL SCORE " << score << std::endl;
+  return 0;
 }
 
 int main(int argc, char **argv) {
-  readProblem<int>(argc > 1 ? argv[1]  : "maze_small.bin",      MAZE,       problems);
-  readProblem<int>(argc > 2 ? argv[2]  : "sudoku_small.bin",    SUDOKU,     problems);
-  readProblem<int>(argc > 3 ? argv[3]  : "array_small.bin",     ARRAY,      problems);
-  readProblem<int>(argc > 5 ? argv[5]  : "tree_small.bin",      TREE,       problems);
-  readProblem<char>(argc > 4 ? argv[4] : "password_small.bin",  PASSWORD,   problems);
-  readProblem<char>(argc > 6 ? argv[6] : "RLE_small.bin",       RLE,        problems);
+  po::options_description desc("Usage: Server [options] [maze sudoku array password tree RLE]\nOptions");
+  desc.add_options()
+    ("help", "print this message")
+    ("seed", po::value<unsigned>(), "seed the problem selection so runs can be replayed")
+    ("trace", po::value<std::string>(&tracePath), "write a binary trace of every batch to this file on exit")
+    ("stats-interval", po::value<unsigned>()->default_value(10), "seconds between latency reports, 0 to only report on exit")
+    ("log-level", po::value<std::string>()->default_value("info"), "debug, info, warn or error")
+    ("max-window", po::value<unsigned>(&maxWindow)->default_value(16), "most batches a client may negotiate to have in flight")
+    ("max-batch-width", po::value<unsigned>(&maxBatchWidth)->default_value(MAX_BATCH_WIDTH), "most problems a client may negotiate per batch")
+    ("stats-port", po::value<unsigned short>()->default_value(0), "local port serving stats snapshots, 22023 for instance; none by default")
+    ("weights", po::value<std::string>(), "category weights, as maze=2,tree=0 (1 when left out)")
+    ("sizes", po::value<std::vector<std::string>>(), "size classes to draw from, as maze=4K:1,16K:3 or maze=largest (repeatable)")
+    ("generate", po::value<unsigned>()->default_value(0), "generate fresh problems on this many threads instead of serving the problem sets")
+    ("generate-memory", po::value<unsigned>()->default_value(256), "MiB of generated batches kept ready, split between the shards")
+    ("unix-socket", po::value<std::string>()->default_value(""), "also listen on this Unix domain socket, /tmp/csgames.sock for instance")
+    ("compress", po::bool_switch(&compressPayloads), "compress the problems for the clients that ask")
+    ("ring-size", po::value<unsigned>()->default_value(64), "MiB of shared ring offered to each client on the Unix domain socket, 0 for none")
+    ("shards", po::value<unsigned>()->default_value(1), "server processes sharing the port, the problems and the cores")
+    ("page-cache", po::value<unsigned>()->default_value(0), "MiB of memory to read datasets into as their problems are sent, split between the shards; 0 maps them whole")
+    ("deadline-base", po::value<double>(&deadlines.baseMilliseconds)->default_value(deadlines.baseMilliseconds), "milliseconds every batch gets to be answered, before its elements")
+    ("deadline-cost", po::value<std::string>(), "nanoseconds more per element of a batch, as maze=2000,array=250")
+    ("deadline-max", po::value<double>(&deadlines.maxMilliseconds)->default_value(deadlines.maxMilliseconds), "most milliseconds a batch gets to be answered")
+    ("problem-sets", po::value<std::vector<std::string>>(), "problem set files");
+  po::positional_options_description positional;
+  positional.add("problem-sets", -1);
+
+  po::variables_map vm;
+  try {
+    po::store(po::command_line_parser(argc, argv).options(desc).positional(positional).run(), vm);
+    po::notify(vm);
+  } catch (po::error &e) {
+    std::cerr << e.what() << std::endl << desc << std::endl;
+    return 1;
+  }
+  if (vm.count("help")) {
+    std::cout << desc << std::endl;
+    return 0;
+  }
+  if (vm.count("seed"))
+    seed = vm["seed"].as<unsigned>();
+  maxBatchWidth = std::min(maxBatchWidth, MAX_BATCH_WIDTH);
+  // Ring offsets are 32 bits
+  ringSize = static_cast<size_t>(std::min(vm["ring-size"].as<unsigned>(), 4095u)) << 20;
+  std::string unixSocket = vm["unix-socket"].as<std::string>();
+  SamplerConfig samplerConfig;
+  if (vm.count("weights") && !parseCategoryWeights(vm["weights"].as<std::string>(), samplerConfig)) {
+    std::cerr << "Bad category weights " << vm["weights"].as<std::string>() << std::endl;
+    return 1;
+  }
+  if (vm.count("sizes")) {
+    for (auto &sizes : vm["sizes"].as<std::vector<std::string>>()) {
+      if (!parseSizeWeights(sizes, samplerConfig)) {
+        std::cerr << "Bad size classes " << sizes << std::endl;
+        return 1;
+      }
+    }
+  }
+  if (vm.count("deadline-cost") && !parseDeadlineCosts(vm["deadline-cost"].as<std::string>(), deadlines)) {
+    std::cerr << "Bad deadline costs " << vm["deadline-cost"].as<std::string>() << std::endl;
+    return 1;
+  }
+  LogLevel logLevel;
+  if (!parseLogLevel(vm["log-level"].as<std::string>(), logLevel)) {
+    std::cerr << "Unknown log level " << vm["log-level"].as<std::string>() << std::endl;
+    return 1;
+  }
+
+  // Problem sets in the order of the usage line
+  std::vector<std::string> sets = { "maze_small.bin", "sudoku_small.bin", "array_small.bin",
+                                    "password_small.bin", "tree_small.bin", "RLE_small.bin" };
+  if (vm.count("problem-sets")) {
+    auto &names = vm["problem-sets"].as<std::vector<std::string>>();
+    std::copy_n(names.begin(), std::min(names.size(), sets.size()), sets.begin());
+  }
+
+  deadlines.print(std::cout);
 
-  std::cout << problems.getGlobalSize() << " problems loaded" << std::endl;
+  // Shards are forked before any thread is started. Each keeps its share of
+  // the problems and of the cores, and a Unix socket and trace of its own.
+  unsigned short statsPort = vm["stats-port"].as<unsigned short>();
+  unsigned statsInterval = vm["stats-interval"].as<unsigned>();
+  shardCount = std::max(1u, vm["shards"].as<unsigned>());
+  std::string shardCores;
+  if (shardCount > 1) {
+    scoreboard = Scoreboard::create(shardCount);
+    if (!scoreboard) {
+      std::cerr << "Could not map the scoreboard of the shards" << std::endl;
+      return 1;
+    }
+
+    std::cout.flush();
+    std::vector<pid_t> shards;
+    for (unsigned shard = 0; shard < shardCount; ++shard) {
+      pid_t pid = ::fork();
+      if (pid < 0) {
+        std::perror("fork");
+        for (pid_t started : shards)
+          ::kill(started, SIGTERM);
+        return 1;
+      }
+      if (pid == 0) {
+        shardIndex = shard;
+        break;
+      }
+      shards.push_back(pid);
+    }
+    if (shards.size() == shardCount)
+      return superviseShards(shards, statsPort, statsInterval, logLevel);
+
+    // Shards do not outlive the process that started them, and are out of
+    // the way of Ctrl-C, which it passes on
+    ::prctl(PR_SET_PDEATHSIG, SIGTERM);
+    ::setpgid(0, 0);
+    shardCores = pinShard(shardIndex, shardCount);
+    std::string suffix = "." + std::to_string(shardIndex);
+    if (!unixSocket.empty())
+      unixSocket += suffix;
+    if (!tracePath.empty())
+      tracePath += suffix;
+    if (seed)
+      seed = seed.get() + shardIndex * 7919u;
+    statsPort = 0;
+    statsInterval = 0;
+  }
+
+  if (unsigned pageCacheSize = vm["page-cache"].as<unsigned>()) {
+    // Each shard pages through a cache of its own, of its share of the size
+    pageCache = PageCache::create((static_cast<size_t>(pageCacheSize) << 20) / shardCount);
+    std::cout << "Paging datasets through " << pageCache->getCapacity() / (1024 * 1024)
+              << " MiB of memory" << (shardCount > 1 ? " per shard" : "") << std::endl;
+  }
+
+  unsigned generatorThreads = vm["generate"].as<unsigned>();
+  if (generatorThreads) {
+    // Size classes are drawn as with the sets, left out they are the usual sizes
+    if (std::all_of(samplerConfig.categoryWeights.begin(), samplerConfig.categoryWeights.end(),
+                    [](double weight) { return weight == 0.; })) {
+      std::cerr << "No problems to generate with these weights" << std::endl;
+      return 1;
+    }
+    size_t budget = (static_cast<size_t>(vm["generate-memory"].as<unsigned>()) << 20) / shardCount;
+    generator.reset(new ProblemGenerator(generatorThreads, samplerConfig, seed, compressPayloads, budget));
+    std::cout << "Generating problems on " << generatorThreads << " threads" << std::endl;
+  } else {
+    std::unique_ptr<ProblemSet> set = loadProblemSets(sets, samplerConfig, std::cout);
+    if (!set) {
+      std::cerr << "No problems to send with these weights and sizes" << std::endl;
+      return 1;
+    }
+    if (vm.count("weights") || vm.count("sizes"))
+      set->sampler.print(std::cout);
+    problemStore.publish(std::move(set));
+  }
 
+  // Only the socket this server bound is removed on the way out
+  bool ownsUnixSocket = false;
   try {
     boost::asio::io_service IOService;
-    TCPServer Server(IOService);
-    if (bool_dist2(e1)) {
+    TCPServer Server(IOService, tcp::endpoint(tcp::v4(), 22022), false);
+    std::unique_ptr<TCPServer> LocalServer;
+    if (!unixSocket.empty() && claimUnixSocket(unixSocket)) {
+      LocalServer.reset(new TCPServer(
+          IOService, boost::asio::local::stream_protocol::endpoint(unixSocket), true));
+      ownsUnixSocket = true;
+    }
+    TimerWheelTicker Ticker(IOService, timers);
+    LatencyReporter Reporter(IOService, statsInterval);
+    std::unique_ptr<ShardPublisher> Publisher;
+    if (scoreboard)
+      Publisher.reset(new ShardPublisher(IOService));
+    std::unique_ptr<ProblemSetReloader> Reloader;
+    if (!generator)
+      Reloader.reset(new ProblemSetReloader(IOService, sets, samplerConfig));
+    std::unique_ptr<StatsServer> StatsEndpoint;
+    if (statsPort)
+      StatsEndpoint = StatsServer::start(IOService, statsPort);
+
+    // Stop cleanly on Ctrl-C so the session can still be written out
+    boost::asio::signal_set signals(IOService, SIGINT, SIGTERM);
+    signals.async_wait([&](const boost::system::error_code &, int) { IOService.stop(); });
+
+    // Seeded runs are benchmarks, leave the welcome lottery out of them,
+    // and the shards leave it to the process that started them
+    if (shardCount > 1) {
+      std::cout << "Shard " << shardIndex << " of " << shardCount << " on " << shardCores
+                << std::endl;
+    } else if (seed) {
+      std::cout << "Waiting for client... (seed " << seed.get() << ")" << std::endl;
+    } else if (bool_dist2(e1)) {
       std::cout << base64_decode(not_welcome) << std::endl << std::endl;
       for (;;) {
         for (int t = 0; t < 5; ++t) {
@@ -369,12 +1548,32 @@ int main(int argc, char **argv) {
     } else {
       std::cout << "Waiting for client..." << std::endl;
     }
+    logger.start(logLevel);
     IOService.run();
   } catch (std::exception &e) {
     std::cerr << e.what() << std::endl;
   }
-  for (int i = 0; i < 5; ++i)
-      std::cout << "FINAL SCORE " << score << std::endl;
+  logger.stop();
+  if (ownsUnixSocket)
+    std::remove(unixSocket.c_str());
+  if (generator) {
+    std::cout << generator->getMisses() << " times no generated batch was ready for a client" << std::endl;
+    if (uint64_t failures = generator->getAllocationFailures())
+      std::cout << failures << " batches not generated for lack of memory" << std::endl;
+    generator.reset();
+  }
+  if (pageCache)
+    pageCache->print(std::cout);
+  // A shard's score is reported by the process that started it, once the
+  // publisher has handed it over
+  if (!scoreboard) {
+    latencies.print(std::cout);
+    for (int i = 0; i < 5; ++i)
+        std::cout << "FINAL SCORE " << score << std::endl;
+  }
+
+  if (!tracePath.empty() && !trace.write(tracePath, seed))
+    std::cerr << "Could not write the session trace to " << tracePath << std::endl;
 
   return 0;
 }
@@ -0,0 +1,84 @@
+#include "shared_ring.h"
+
+#include "protocol.h"
+
+#include <boost/interprocess/exceptions.hpp>
+
+using namespace boost::interprocess;
+
+std::unique_ptr<SharedRing> SharedRing::create(uint32_t key, size_t capacity) {
+  try {
+    return std::unique_ptr<SharedRing>(new SharedRing(key, capacity));
+  } catch (const interprocess_exception &) {
+    // Taken, or shared memory is not available
+    return nullptr;
+  }
+}
+
+SharedRing::SharedRing(uint32_t key, size_t capacity)
+    : mKey(key), mName(sharedRingName(key)), mCapacity(capacity),
+      mSegment(create_only, mName.c_str(), read_write) {
+  try {
+    mSegment.truncate(capacity);
+    mRegion = mapped_region(mSegment, read_write);
+  } catch (...) {
+    shared_memory_object::remove(mName.c_str());
+    throw;
+  }
+}
+
+SharedRing::~SharedRing() {
+  // Clients that mapped the ring keep their mapping
+  shared_memory_object::remove(mName.c_str());
+}
+
+bool SharedRing::allocate(size_t problemBytes, uint32_t sequence, uint32_t &offset) {
+  const size_t tagBytes = sizeof(uint32_t);
+  size_t bytes = tagBytes + (problemBytes + tagBytes - 1) / tagBytes * tagBytes;
+  if (problemBytes == 0 || bytes > mCapacity)
+    return false;
+
+  if (mRegions.empty()) {
+    offset = 0;
+  } else {
+    // Free space is past the newest region up to the end of the ring and
+    // from the start up to the oldest one, or between the two once the
+    // newest has wrapped around
+    const Region &oldest = mRegions.front();
+    const Region &newest = mRegions.back();
+    size_t tail = newest.offset + newest.bytes;
+    if (newest.offset >= oldest.offset) {
+      if (tail + bytes <= mCapacity)
+        offset = static_cast<uint32_t>(tail);
+      else if (bytes <= oldest.offset)
+        offset = 0;
+      else
+        return false;
+    } else if (tail + bytes <= oldest.offset) {
+      offset = static_cast<uint32_t>(tail);
+    } else {
+      return false;
+    }
+  }
+
+  mRegions.push_back(Region{ offset, static_cast<uint32_t>(bytes), false });
+  tagAt(offset).store(sequence, std::memory_order_relaxed);
+  offset += static_cast<uint32_t>(tagBytes);
+  return true;
+}
+
+void SharedRing::release(uint32_t offset) {
+  offset -= static_cast<uint32_t>(sizeof(uint32_t));
+  for (Region &region : mRegions) {
+    if (region.offset == offset && !region.released) {
+      region.released = true;
+      // Whoever sees what is written over the region past this fence sees
+      // the tag cleared too
+      tagAt(offset).store(RELEASED_RING_TAG, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      break;
+    }
+  }
+  while (!mRegions.empty() && mRegions.front().released)
+    mRegions.pop_front();
+}
@@ -0,0 +1,63 @@
+#ifndef SHARED_RING_H
+#define SHARED_RING_H
+
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+
+// Shared memory segment a client on the same machine maps to read its
+// batches in place, see protocol.h. Space is handed out in allocation order
+// around the ring and comes back as batches are released, in any order:
+// a released region is only reused once every region allocated before it
+// has been released too. Every region starts with the tag protocol.h
+// describes. Owned by the io thread of its connection.
+class SharedRing {
+public:
+  // Null if the segment could not be created
+  static std::unique_ptr<SharedRing> create(uint32_t key, size_t capacity);
+  ~SharedRing();
+
+  SharedRing(const SharedRing &) = delete;
+  SharedRing &operator=(const SharedRing &) = delete;
+
+  // Reserves `bytes` contiguous bytes at `offset`, after a tag holding
+  // `sequence`. False when the ring is too full.
+  bool allocate(size_t bytes, uint32_t sequence, uint32_t &offset);
+  // Clears the tag of the region at `offset`, before its space can be
+  // written over
+  void release(uint32_t offset);
+
+  char *data() { return static_cast<char *>(mRegion.get_address()); }
+  uint32_t getKey() const { return mKey; }
+
+private:
+  // From its tag to the end of its problems, rounded up to keep the next
+  // tag aligned
+  struct Region {
+    uint32_t offset;
+    uint32_t bytes;
+    bool released;
+  };
+
+  SharedRing(uint32_t key, size_t capacity);
+
+  std::atomic<uint32_t> &tagAt(uint32_t offset) {
+    return *reinterpret_cast<std::atomic<uint32_t> *>(data() + offset);
+  }
+
+  uint32_t mKey;
+  std::string mName;
+  size_t mCapacity;
+  boost::interprocess::shared_memory_object mSegment;
+  boost::interprocess::mapped_region mRegion;
+  // Live regions, oldest first
+  std::deque<Region> mRegions;
+};
+
+#endif // SHARED_RING_H
@@ -0,0 +1,321 @@
+#include "dataset.h"
+#include "handlers.h"
+#include "problems.h"
+#include "sampler.h"
+#include "solvers.h"
+
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace po = boost::program_options;
+
+namespace {
+
+struct Options {
+  unsigned warmup;
+  unsigned repetitions;
+  double minMilliseconds;
+  unsigned width;
+};
+
+// A group of problems as the client would get it in a batch
+struct Group {
+  size_t first;
+  size_t count;
+  Problems<unsigned> iProblems;
+  Problems<char> sProblems;
+  std::vector<unsigned> expectedValues;
+};
+
+// The problems of a set, in groups, the groups split by the size class of
+// their largest problem, which their solving time goes by
+struct Pool {
+  std::string name;
+  ProblemType type;
+  ProblemContainer problems;
+  std::vector<Group> groups;
+  boost::array<std::vector<size_t>, ProblemSampler::NB_SIZE_CLASSES> buckets;
+
+  const ProblemArena &getArena() const { return problems.getArena(type); }
+};
+
+// Solves a group into `answers`, one byte per problem
+typedef void (*Kernel)(const Pool &pool, const Group &group, unsigned char *answers);
+
+void solveWithHandler(const Pool &pool, const Group &group, unsigned char *answers) {
+  Answers answer_buf;
+  switch (pool.type) {
+  case MAZE:
+    answer_buf = handleMazeProblem(group.iProblems);
+    break;
+  case SUDOKU:
+    answer_buf = handleSudokuProblem(group.iProblems);
+    break;
+  case TREE:
+    answer_buf = handleTreeProblem(group.iProblems);
+    break;
+  case ARRAY:
+    answer_buf = handleArrayProblem(group.iProblems, group.expectedValues);
+    break;
+  case PASSWORD:
+    answer_buf = handlePasswordProblem(group.sProblems);
+    break;
+  case RLE:
+    answer_buf = handleRLEProblem(group.sProblems, group.expectedValues);
+    break;
+  default:
+    break;
+  }
+  for (size_t i = 0; i < group.count; ++i)
+    answers[i] = i < answer_buf.size() && answer_buf[i];
+}
+
+void solveWithReference(const Pool &pool, const Group &group, unsigned char *answers) {
+  solveProblems(pool.type, pool.getArena(), group.first, group.count,
+                static_cast<unsigned>(group.count), answers);
+}
+
+const struct {
+  const char *name;
+  Kernel kernel;
+} kernels[] = {
+  // The solvers of the client, handlers.h
+  { "handler", solveWithHandler },
+  // The reference solvers, solvers.h
+  { "reference", solveWithReference },
+};
+
+struct Result {
+  std::string set;
+  ProblemType type;
+  const char *kernel;
+  int sizeClass;
+  size_t problems;
+  size_t elements;
+  size_t bytes;
+  unsigned passes;
+  double meanNs;
+  double stddevNs;
+  double minNs;
+  size_t mismatches;
+};
+
+bool loadPool(const std::string &name, ProblemType type, unsigned defaultWidth, Pool &pool) {
+  pool.name = name;
+  pool.type = type;
+  readProblem(name, type, pool.problems, false);
+  const ProblemArena &arena = pool.getArena();
+  if (arena.size() == 0) {
+    std::cerr << name << ": no " << getProblemTypeName(type) << " problems" << std::endl;
+    return false;
+  }
+
+  unsigned width = getGroupWidth(MappedFile(name));
+  if (width == 0)
+    width = defaultWidth;
+  for (size_t first = 0; first < arena.size(); first += width) {
+    Group group;
+    group.first = first;
+    group.count = std::min<size_t>(width, arena.size() - first);
+    size_t largest = 0;
+    for (size_t i = first; i < first + group.count; ++i) {
+      boost::asio::const_buffer payload = arena.getPayload(i);
+      const unsigned *data = boost::asio::buffer_cast<const unsigned *>(payload);
+      if (type < PASSWORD)
+        group.iProblems.emplace_back(data, data + arena.getLength(i));
+      else
+        group.sProblems.emplace_back(data, data + arena.getLength(i));
+      group.expectedValues.push_back(arena.getExpectedValue(i).get_value_or(0));
+      largest = std::max<size_t>(largest, arena.getLength(i));
+    }
+    pool.buckets[ProblemSampler::sizeClassOf(largest)].push_back(pool.groups.size());
+    pool.groups.push_back(std::move(group));
+  }
+  return true;
+}
+
+// One pass of a kernel over the groups of a bucket, in milliseconds
+double runPass(const Pool &pool, const std::vector<size_t> &bucket, Kernel kernel,
+               std::vector<unsigned char> &answers) {
+  auto start = std::chrono::steady_clock::now();
+  for (size_t index : bucket) {
+    const Group &group = pool.groups[index];
+    kernel(pool, group, &answers[group.first]);
+  }
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// Times a kernel over a bucket: warm-up passes, which also find how many
+// passes make a repetition last long enough to time, then the repetitions.
+// Answers are checked after the last one.
+Result measure(const Pool &pool, int sizeClass, const char *name, Kernel kernel,
+               const Options &options) {
+  const ProblemArena &arena = pool.getArena();
+  const std::vector<size_t> &bucket = pool.buckets[sizeClass];
+  Result result{ pool.name, pool.type, name, sizeClass, 0, 0, 0, 1, 0., 0., 0., 0 };
+  for (size_t index : bucket) {
+    const Group &group = pool.groups[index];
+    result.problems += group.count;
+    for (size_t i = group.first; i < group.first + group.count; ++i)
+      result.elements += arena.getLength(i);
+  }
+  result.bytes = result.elements * (pool.type < PASSWORD ? sizeof(int) : sizeof(char));
+
+  std::vector<unsigned char> answers(arena.size(), 0);
+  double slowest = 0.;
+  for (unsigned i = 0; i < options.warmup; ++i)
+    slowest = std::max(slowest, runPass(pool, bucket, kernel, answers));
+  if (slowest > 0.)
+    result.passes = std::max(1u, static_cast<unsigned>(std::ceil(options.minMilliseconds / slowest)));
+
+  std::vector<double> samples;
+  for (unsigned i = 0; i < options.repetitions; ++i) {
+    double milliseconds = 0.;
+    for (unsigned pass = 0; pass < result.passes; ++pass)
+      milliseconds += runPass(pool, bucket, kernel, answers);
+    samples.push_back(milliseconds * 1e6 / (result.passes * double(result.problems)));
+  }
+
+  double sum = 0.;
+  for (double sample : samples)
+    sum += sample;
+  result.meanNs = sum / samples.size();
+  double squares = 0.;
+  for (double sample : samples)
+    squares += (sample - result.meanNs) * (sample - result.meanNs);
+  result.stddevNs = samples.size() > 1 ? std::sqrt(squares / (samples.size() - 1)) : 0.;
+  result.minNs = *std::min_element(samples.begin(), samples.end());
+
+  for (size_t index : bucket) {
+    const Group &group = pool.groups[index];
+    for (size_t i = group.first; i < group.first + group.count; ++i)
+      result.mismatches += (answers[i] != 0) != arena.getAnswer(i);
+  }
+  return result;
+}
+
+void printResult(const Result &result, std::ostream &out) {
+  double seconds = result.meanNs * result.problems / 1e9;
+  out << std::fixed << std::setprecision(1) << std::left << std::setw(10)
+      << getProblemTypeName(result.type) << std::setw(11) << result.kernel << std::setw(6)
+      << ProblemSampler::getSizeClassName(result.sizeClass) << std::right << std::setw(9)
+      << result.problems << std::setw(14) << result.meanNs << " +- " << std::setw(10)
+      << result.stddevNs << std::setw(10)
+      << result.elements / seconds / 1e6 << std::setw(10) << result.bytes / seconds / 1e6
+      << std::setw(12) << result.mismatches << std::endl;
+}
+
+void writeJson(const std::vector<Result> &results, const std::string &label,
+               const Options &options, std::ostream &out) {
+  out << "{\"label\":\"" << label << "\",\"warmup\":" << options.warmup
+      << ",\"repetitions\":" << options.repetitions << ",\"results\":[";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result &result = results[i];
+    double seconds = result.meanNs * result.problems / 1e9;
+    out << (i ? "," : "") << "{\"set\":\"" << result.set << "\",\"category\":\""
+        << getProblemTypeName(result.type) << "\",\"kernel\":\"" << result.kernel
+        << "\",\"size_class\":\"" << ProblemSampler::getSizeClassName(result.sizeClass)
+        << "\",\"problems\":" << result.problems << ",\"elements\":" << result.elements
+        << ",\"bytes\":" << result.bytes << ",\"passes\":" << result.passes
+        << ",\"ns_per_problem\":{\"mean\":" << result.meanNs << ",\"stddev\":"
+        << result.stddevNs << ",\"min\":" << result.minNs << "}"
+        << ",\"elements_per_second\":" << result.elements / seconds
+        << ",\"bytes_per_second\":" << result.bytes / seconds
+        << ",\"mismatches\":" << result.mismatches << "}";
+  }
+  out << "]}" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string category, dataDir, suffix, json, label;
+  Options options;
+  po::options_description desc("Usage: SolverBench [options] [set...]\n"
+                               "Times the solvers of the client and the reference solvers over problem sets\nOptions");
+  desc.add_options()
+    ("help", "print this message")
+    ("data", po::value<std::string>(&dataDir)->default_value("data"), "directory of the sets used when none are given")
+    ("suffix", po::value<std::string>(&suffix)->default_value("small"), "which of them, as in maze_small.bin")
+    ("category", po::value<std::string>(&category), "category of the sets, guessed from their names otherwise")
+    ("width", po::value<unsigned>(&options.width)->default_value(4), "problems per group of datasets, which do not record it")
+    ("warmup", po::value<unsigned>(&options.warmup)->default_value(2), "untimed passes over each bucket")
+    ("repetitions", po::value<unsigned>(&options.repetitions)->default_value(5), "timed repetitions of each bucket")
+    ("min-ms", po::value<double>(&options.minMilliseconds)->default_value(20.), "passes are repeated until a repetition lasts this long")
+    ("json", po::value<std::string>(&json), "also write the results to this file as JSON")
+    ("label", po::value<std::string>(&label), "label of the JSON results, a commit for instance")
+    ("sets", po::value<std::vector<std::string>>(), "problem sets or datasets");
+  po::positional_options_description positional;
+  positional.add("sets", -1);
+
+  po::variables_map vm;
+  try {
+    po::store(po::command_line_parser(argc, argv).options(desc).positional(positional).run(), vm);
+    po::notify(vm);
+  } catch (po::error &e) {
+    std::cerr << e.what() << std::endl << desc << std::endl;
+    return 1;
+  }
+  if (vm.count("help")) {
+    std::cout << desc << std::endl;
+    return 0;
+  }
+  if (options.width == 0 || options.repetitions == 0) {
+    std::cerr << "--width and --repetitions must be at least 1" << std::endl;
+    return 1;
+  }
+
+  std::vector<std::string> sets;
+  if (vm.count("sets")) {
+    sets = vm["sets"].as<std::vector<std::string>>();
+  } else {
+    for (int type = 0; type < ProblemType::NB_ELEMS; ++type)
+      sets.push_back(dataDir + "/" + getProblemTypeName(static_cast<ProblemType>(type)) + "_" +
+                     suffix + ".bin");
+  }
+
+  std::cout << std::left << std::setw(10) << "category" << std::setw(11) << "kernel"
+            << std::setw(6) << "size" << std::right << std::setw(9) << "problems"
+            << std::setw(28) << "ns/problem +- stddev" << std::setw(10) << "Melem/s"
+            << std::setw(10) << "MB/s" << std::setw(12) << "mismatches" << std::endl;
+
+  std::vector<Result> results;
+  for (auto &name : sets) {
+    ProblemType type;
+    if (category.empty() ? !guessProblemType(name, type) : !parseProblemType(category, type)) {
+      std::cerr << "No category for " << name << ", give one with --category" << std::endl;
+      return 1;
+    }
+
+    Pool pool;
+    if (!loadPool(name, type, options.width, pool))
+      return 1;
+    for (int sizeClass = 0; sizeClass < ProblemSampler::NB_SIZE_CLASSES; ++sizeClass) {
+      if (pool.buckets[sizeClass].empty())
+        continue;
+      for (auto &kernel : kernels) {
+        results.push_back(measure(pool, sizeClass, kernel.name, kernel.kernel, options));
+        printResult(results.back(), std::cout);
+      }
+    }
+  }
+
+  if (!json.empty()) {
+    std::ofstream out(json);
+    writeJson(results, label, options, out);
+    if (!out) {
+      std::cerr << "Could not write " << json << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
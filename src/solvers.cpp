@@ -0,0 +1,265 @@
+#include "solvers.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace {
+
+// Side of a square of `size` cells, 0 if there is none
+size_t squareSide(size_t size) {
+  size_t side = static_cast<size_t>(std::llround(std::sqrt(static_cast<double>(size))));
+  return side * side == size ? side : 0;
+}
+
+struct TreeNode {
+  int value;
+  int left, right;
+};
+
+// Reads a subtree in preorder from `pos`, returning its root or -1 when it
+// is empty. `complete` is cleared if the values run out.
+int readSubtree(const ProblemView<TREE> &tree, size_t &pos, std::vector<TreeNode> &nodes,
+                bool &complete) {
+  if (pos >= tree.size()) {
+    complete = false;
+    return -1;
+  }
+  int value = tree[pos++];
+  if (value == -1)
+    return -1;
+
+  int root = static_cast<int>(nodes.size());
+  nodes.push_back(TreeNode{ value, -1, -1 });
+  // Nodes whose children are still being read, and how many were
+  std::vector<std::pair<int, int>> stack{ { root, 0 } };
+  while (!stack.empty()) {
+    int node = stack.back().first;
+    int child = stack.back().second++;
+    if (child == 2) {
+      stack.pop_back();
+      continue;
+    }
+    if (pos >= tree.size()) {
+      complete = false;
+      return root;
+    }
+
+    value = tree[pos++];
+    int index = -1;
+    if (value != -1) {
+      index = static_cast<int>(nodes.size());
+      nodes.push_back(TreeNode{ value, -1, -1 });
+      stack.emplace_back(index, 0);
+    }
+    (child == 0 ? nodes[node].left : nodes[node].right) = index;
+  }
+  return root;
+}
+
+// Letters of a password, case aside and in any order
+std::string lettersOf(const ProblemView<PASSWORD> &password) {
+  uint32_t counts[256] = {};
+  for (size_t i = 0; i < password.size(); ++i)
+    ++counts[static_cast<unsigned char>(std::tolower(static_cast<unsigned char>(password[i])))];
+
+  std::string letters;
+  for (int c = 0; c < 256; ++c) {
+    if (counts[c] == 0)
+      continue;
+    letters.push_back(static_cast<char>(c));
+    letters.append(reinterpret_cast<const char *>(&counts[c]), sizeof(counts[c]));
+  }
+  return letters;
+}
+
+} // namespace
+
+bool solveMaze(const ProblemView<MAZE> &maze) {
+  size_t side = squareSide(maze.size());
+  if (side < 3)
+    return false;
+  size_t start = side + 1, goal = (side - 2) * side + side - 2;
+  if (maze[start] != 1)
+    return false;
+
+  std::vector<unsigned char> seen(maze.size(), 0);
+  std::vector<size_t> queue{ start };
+  seen[start] = 1;
+  for (size_t head = 0; head < queue.size(); ++head) {
+    size_t cell = queue[head];
+    if (cell == goal)
+      return true;
+
+    size_t row = cell / side, col = cell % side;
+    size_t next[4], count = 0;
+    if (row > 0)
+      next[count++] = cell - side;
+    if (row + 1 < side)
+      next[count++] = cell + side;
+    if (col > 0)
+      next[count++] = cell - 1;
+    if (col + 1 < side)
+      next[count++] = cell + 1;
+    for (size_t i = 0; i < count; ++i) {
+      if (maze[next[i]] == 1 && !seen[next[i]]) {
+        seen[next[i]] = 1;
+        queue.push_back(next[i]);
+      }
+    }
+  }
+  return false;
+}
+
+bool solveSudoku(const ProblemView<SUDOKU> &sudoku) {
+  size_t side = squareSide(sudoku.size());
+  size_t k = squareSide(side);
+  if (k == 0)
+    return false;
+
+  // Each row, column and box marks its digits with a number of its own
+  std::vector<size_t> marks(side + 1, 0);
+  size_t mark = 0;
+  auto holdsEachDigit = [&](size_t first, size_t rowStep, size_t colStep, size_t cols) {
+    ++mark;
+    for (size_t i = 0; i < side; ++i) {
+      int digit = sudoku[first + (i / cols) * rowStep + (i % cols) * colStep];
+      if (digit < 1 || static_cast<size_t>(digit) > side || marks[digit] == mark)
+        return false;
+      marks[digit] = mark;
+    }
+    return true;
+  };
+
+  for (size_t i = 0; i < side; ++i) {
+    if (!holdsEachDigit(i * side, 0, 1, side) || !holdsEachDigit(i, 0, side, side))
+      return false;
+    if (!holdsEachDigit((i / k) * k * side + (i % k) * k, side, 1, k))
+      return false;
+  }
+  return true;
+}
+
+bool solveTree(const ProblemView<TREE> &tree) {
+  std::vector<TreeNode> nodes;
+  size_t pos = 0;
+  bool complete = true;
+  if (tree.size() == 0 || tree[pos++] == -1)
+    return true;
+  int left = readSubtree(tree, pos, nodes, complete);
+  int right = complete ? readSubtree(tree, pos, nodes, complete) : -1;
+  if (!complete)
+    return false;
+
+  // The left subtree read left to right against the right one read right
+  // to left
+  std::vector<std::pair<int, int>> stack{ { left, right } };
+  while (!stack.empty()) {
+    std::pair<int, int> pair = stack.back();
+    stack.pop_back();
+    if (pair.first < 0 || pair.second < 0) {
+      if (pair.first != pair.second)
+        return false;
+      continue;
+    }
+    const TreeNode &a = nodes[pair.first], &b = nodes[pair.second];
+    if (a.value != b.value)
+      return false;
+    stack.emplace_back(a.left, b.right);
+    stack.emplace_back(a.right, b.left);
+  }
+  return true;
+}
+
+bool solveArray(const ProblemView<ARRAY> &array, int expectedValue) {
+  for (size_t i = 0; i < array.size(); ++i)
+    if (array[i] == expectedValue)
+      return true;
+  return false;
+}
+
+bool solveRLE(const ProblemView<RLE> &rle, unsigned expectedLength) {
+  // A count with no character after it repeats nothing
+  uint64_t length = 0, count = 0;
+  for (size_t i = 0; i < rle.size(); ++i) {
+    char c = rle[i];
+    if (c >= '0' && c <= '9') {
+      count = count * 10 + (c - '0');
+    } else {
+      length += count;
+      count = 0;
+    }
+  }
+  return length == expectedLength;
+}
+
+void solvePasswords(const std::vector<ProblemView<PASSWORD>> &group,
+                    std::vector<bool> &answers) {
+  std::vector<std::string> letters;
+  std::unordered_map<std::string, size_t> counts;
+  for (auto &password : group) {
+    letters.push_back(lettersOf(password));
+    ++counts[letters.back()];
+  }
+
+  size_t most = 0;
+  for (size_t i = 1; i < letters.size(); ++i)
+    if (counts[letters[i]] > counts[letters[most]])
+      most = i;
+
+  answers.assign(group.size(), false);
+  for (size_t i = 0; i < group.size(); ++i)
+    answers[i] = letters[i] != letters[most];
+}
+
+void solveProblems(ProblemType type, const ProblemArena &arena, size_t first, size_t count,
+                   unsigned width, unsigned char *answers) {
+  size_t end = first + count;
+  switch (type) {
+  case MAZE:
+    for (size_t i = first; i < end; ++i)
+      answers[i - first] = solveMaze(arena.getData<MAZE>(i));
+    break;
+  case SUDOKU:
+    for (size_t i = first; i < end; ++i)
+      answers[i - first] = solveSudoku(arena.getData<SUDOKU>(i));
+    break;
+  case TREE:
+    for (size_t i = first; i < end; ++i)
+      answers[i - first] = solveTree(arena.getData<TREE>(i));
+    break;
+  case ARRAY:
+    for (size_t i = first; i < end; ++i) {
+      boost::optional<unsigned> expected = arena.getExpectedValue(i);
+      answers[i - first] =
+          expected && solveArray(arena.getData<ARRAY>(i), static_cast<int>(expected.get()));
+    }
+    break;
+  case PASSWORD: {
+    std::vector<ProblemView<PASSWORD>> group;
+    std::vector<bool> groupAnswers;
+    for (size_t start = first; start < end; start += width) {
+      group.clear();
+      size_t stop = std::min<size_t>(start + width, end);
+      for (size_t i = start; i < stop; ++i)
+        group.push_back(arena.getData<PASSWORD>(i));
+      solvePasswords(group, groupAnswers);
+      for (size_t i = start; i < stop; ++i)
+        answers[i - first] = groupAnswers[i - start];
+    }
+    break;
+  }
+  case RLE:
+    for (size_t i = first; i < end; ++i) {
+      boost::optional<unsigned> expected = arena.getExpectedValue(i);
+      answers[i - first] = expected && solveRLE(arena.getData<RLE>(i), expected.get());
+    }
+    break;
+  default:
+    break;
+  }
+}
@@ -0,0 +1,44 @@
+#ifndef SOLVERS_H
+#define SOLVERS_H
+
+#include "problems.h"
+
+#include <cstddef>
+#include <vector>
+
+// Reference solutions to the six categories, as the challenge describes
+// them (docs/). They are written to be obviously right rather than fast,
+// and are what the answers of a problem set are checked against:
+//  - a maze is a square grid of 1 for open and 0 for walled cells, solvable
+//    if a path of open cells joins the cell after the top left corner to
+//    the one before the bottom right corner
+//  - a sudoku is a k^2 x k^2 grid, valid if every row, column and k x k box
+//    holds each of 1 to k^2 once
+//  - a tree is its root value then both subtrees in preorder, -1 for a
+//    missing node, symmetric if one subtree is the mirror image of the
+//    other
+//  - an array answers whether it holds the expected value
+//  - a password answers whether its letters, case aside, differ from those
+//    of most of its group
+//  - an RLE string answers whether it decodes to the expected length
+// Malformed problems, a maze that is not square for instance, are answered
+// false.
+
+bool solveMaze(const ProblemView<MAZE> &maze);
+bool solveSudoku(const ProblemView<SUDOKU> &sudoku);
+bool solveTree(const ProblemView<TREE> &tree);
+bool solveArray(const ProblemView<ARRAY> &array, int expectedValue);
+bool solveRLE(const ProblemView<RLE> &rle, unsigned expectedLength);
+
+// Passwords are only different in relation to the rest of their group, so
+// they are solved a group at a time. Ties go to the letters seen first.
+void solvePasswords(const std::vector<ProblemView<PASSWORD>> &group,
+                    std::vector<bool> &answers);
+
+// Solves problems [first, first + count) of an arena into `answers`, one
+// byte per problem. For passwords the range must be whole groups of
+// `width` problems, counted from the start of the arena.
+void solveProblems(ProblemType type, const ProblemArena &arena, size_t first, size_t count,
+                   unsigned width, unsigned char *answers);
+
+#endif // SOLVERS_H
@@ -0,0 +1,129 @@
+#include "stats.h"
+#include "page_cache.h"
+
+#include <iomanip>
+
+static const char *categoryCounterNames[NB_CATEGORY_COUNTERS] = {
+  "sent", "correct", "wrong", "timeouts", "bytes"
+};
+
+static const char *serverCounterNames[NB_SERVER_COUNTERS] = {
+  "sessions_opened", "sessions_closed", "answers", "late_answers"
+};
+
+Stats::Block::Block() {
+  for (auto &counters : categories)
+    for (auto &counter : counters)
+      counter.store(0, std::memory_order_relaxed);
+  for (auto &counter : server)
+    counter.store(0, std::memory_order_relaxed);
+}
+
+Stats::Block &Stats::local() {
+  thread_local const Stats *owner = nullptr;
+  thread_local Block *block = nullptr;
+  if (owner != this) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mBlocks.emplace_back(new Block);
+    block = mBlocks.back().get();
+    owner = this;
+  }
+  return *block;
+}
+
+StatsSnapshot Stats::snapshot() const {
+  StatsSnapshot snapshot;
+  for (auto &counters : snapshot.categories)
+    counters.fill(0);
+  snapshot.server.fill(0);
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  for (auto &block : mBlocks) {
+    for (int type = 0; type < ProblemType::NB_ELEMS; ++type)
+      for (int counter = 0; counter < NB_CATEGORY_COUNTERS; ++counter)
+        snapshot.categories[type][counter] +=
+            block->categories[type][counter].load(std::memory_order_relaxed);
+    for (int counter = 0; counter < NB_SERVER_COUNTERS; ++counter)
+      snapshot.server[counter] += block->server[counter].load(std::memory_order_relaxed);
+  }
+  return snapshot;
+}
+
+void writeStatsText(std::ostream &out, const StatsSnapshot &snapshot,
+                    int score, const LatencyTable &latencies, const PageCache *pages) {
+  out << "score " << score << std::endl
+      << "sessions " << snapshot.server[SESSIONS_OPENED] - snapshot.server[SESSIONS_CLOSED]
+      << " connected, " << snapshot.server[SESSIONS_OPENED] << " in total" << std::endl
+      << "answers " << snapshot.server[ANSWERS_RECEIVED] << ", "
+      << snapshot.server[ANSWERS_LATE] << " too late" << std::endl
+      << std::endl;
+
+  out << std::left << std::setw(10) << "category" << std::right;
+  for (auto name : categoryCounterNames)
+    out << std::setw(12) << name;
+  out << std::endl;
+  for (int type = 0; type < ProblemType::NB_ELEMS; ++type) {
+    out << std::left << std::setw(10) << getProblemTypeName(static_cast<ProblemType>(type))
+        << std::right;
+    for (auto value : snapshot.categories[type])
+      out << std::setw(12) << value;
+    out << std::endl;
+  }
+  out << std::endl;
+
+  latencies.print(out);
+  if (pages)
+    pages->print(out);
+}
+
+void writeStatsJson(std::ostream &out, const StatsSnapshot &snapshot,
+                    int score, const LatencyTable &latencies, const PageCache *pages) {
+  out << "{\"score\":" << score
+      << ",\"sessions_connected\":"
+      << snapshot.server[SESSIONS_OPENED] - snapshot.server[SESSIONS_CLOSED];
+  for (int counter = 0; counter < NB_SERVER_COUNTERS; ++counter)
+    out << ",\"" << serverCounterNames[counter] << "\":" << snapshot.server[counter];
+
+  out << ",\"categories\":{";
+  for (int type = 0; type < ProblemType::NB_ELEMS; ++type) {
+    out << (type ? "," : "") << "\""
+        << getProblemTypeName(static_cast<ProblemType>(type)) << "\":{";
+    for (int counter = 0; counter < NB_CATEGORY_COUNTERS; ++counter)
+      out << (counter ? "," : "") << "\"" << categoryCounterNames[counter]
+          << "\":" << snapshot.categories[type][counter];
+
+    // Latencies in nanoseconds, by batch size
+    out << ",\"latencies\":{";
+    const char *separator = "";
+    for (int bucket = 0; bucket < LatencyTable::NB_SIZE_BUCKETS; ++bucket) {
+      auto &histogram = latencies.getHistogram(static_cast<ProblemType>(type), bucket);
+      uint64_t timeouts = latencies.getTimeouts(static_cast<ProblemType>(type), bucket);
+      if (histogram.count() == 0 && timeouts == 0)
+        continue;
+      out << separator << "\"" << LatencyTable::getSizeBucketName(bucket) << "\":{"
+          << "\"answers\":" << histogram.count() << ",\"timeouts\":" << timeouts
+          << ",\"p50\":" << histogram.percentile(50)
+          << ",\"p90\":" << histogram.percentile(90)
+          << ",\"p99\":" << histogram.percentile(99)
+          << ",\"max\":" << histogram.max() << "}";
+      separator = ",";
+    }
+    out << "}";
+
+    // Thousandths of the deadline the answers took
+    auto &deadlineUse = latencies.getDeadlineUse(static_cast<ProblemType>(type));
+    out << ",\"deadline_used\":{\"answers\":" << deadlineUse.count()
+        << ",\"p50\":" << deadlineUse.percentile(50)
+        << ",\"p90\":" << deadlineUse.percentile(90)
+        << ",\"p99\":" << deadlineUse.percentile(99)
+        << ",\"max\":" << deadlineUse.max() << "}}";
+  }
+  out << "}";
+
+  // Fault latencies in nanoseconds
+  if (pages) {
+    out << ",\"page_cache\":";
+    pages->writeJson(out);
+  }
+  out << "}" << std::endl;
+}
@@ -0,0 +1,85 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "histogram.h"
+#include "problems.h"
+
+#include <boost/array.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+enum CategoryCounter {
+  BATCHES_SENT,
+  BATCHES_CORRECT,
+  BATCHES_WRONG,
+  BATCHES_TIMED_OUT,
+  BYTES_SENT,
+
+  NB_CATEGORY_COUNTERS
+};
+
+enum ServerCounter {
+  SESSIONS_OPENED,
+  SESSIONS_CLOSED,
+  ANSWERS_RECEIVED,
+  ANSWERS_LATE,
+
+  NB_SERVER_COUNTERS
+};
+
+// Counter values summed over every thread at one point in time
+struct StatsSnapshot {
+  boost::array<boost::array<uint64_t, NB_CATEGORY_COUNTERS>, ProblemType::NB_ELEMS> categories;
+  boost::array<uint64_t, NB_SERVER_COUNTERS> server;
+};
+
+// Server activity counters. Each thread counts in a block of its own, which
+// only it writes, so counting is a relaxed load and store with no sharing
+// between threads; the blocks are only summed when a snapshot is taken.
+// Blocks outlive their thread so nothing counted is lost.
+class Stats {
+public:
+  void add(ProblemType type, CategoryCounter counter, uint64_t value = 1) {
+    bump(local().categories[type][counter], value);
+  }
+
+  void add(ServerCounter counter, uint64_t value = 1) {
+    bump(local().server[counter], value);
+  }
+
+  StatsSnapshot snapshot() const;
+
+private:
+  struct Block {
+    Block();
+
+    boost::array<boost::array<std::atomic<uint64_t>, NB_CATEGORY_COUNTERS>, ProblemType::NB_ELEMS> categories;
+    boost::array<std::atomic<uint64_t>, NB_SERVER_COUNTERS> server;
+  };
+
+  static void bump(std::atomic<uint64_t> &counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value,
+                  std::memory_order_relaxed);
+  }
+
+  Block &local();
+
+  mutable std::mutex mMutex;
+  std::vector<std::unique_ptr<Block>> mBlocks;
+};
+
+class PageCache;
+
+// Snapshot of the counters, score and latency percentiles, and of the page
+// cache if there is one, as aligned text or as a JSON object
+void writeStatsText(std::ostream &out, const StatsSnapshot &snapshot,
+                    int score, const LatencyTable &latencies, const PageCache *pages = nullptr);
+void writeStatsJson(std::ostream &out, const StatsSnapshot &snapshot,
+                    int score, const LatencyTable &latencies, const PageCache *pages = nullptr);
+
+#endif // STATS_H
@@ -0,0 +1,96 @@
+#include "timer_wheel.h"
+
+#include <algorithm>
+
+namespace {
+void unlink(TimerNode &node) {
+  node.prev->next = node.next;
+  node.next->prev = node.prev;
+  node.prev = node.next = nullptr;
+}
+
+void linkBefore(TimerNode &head, TimerNode &node) {
+  node.prev = head.prev;
+  node.next = &head;
+  head.prev->next = &node;
+  head.prev = &node;
+}
+}
+
+void TimerNode::cancel() {
+  if (armed())
+    unlink(*this);
+}
+
+TimerWheel::TimerWheel() : mStart(std::chrono::steady_clock::now()), mCurrent(0) {
+  for (auto &level : mSlots)
+    for (auto &head : level)
+      head.prev = head.next = &head;
+}
+
+TimerWheel::~TimerWheel() {
+  // Leave the timers still armed unlinked rather than pointing in the wheel
+  for (auto &level : mSlots)
+    for (auto &head : level) {
+      while (head.next != &head)
+        unlink(*head.next);
+      head.prev = head.next = nullptr;
+    }
+}
+
+uint64_t TimerWheel::now() const {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now() - mStart).count();
+}
+
+void TimerWheel::arm(TimerNode &node, uint64_t milliseconds) {
+  node.cancel();
+  // Part of the current millisecond has elapsed already, so round up to
+  // never fire early, and never into a slot that has already run
+  node.deadline = std::max<uint64_t>(now() + milliseconds + 1, mCurrent + 1);
+  insert(node);
+}
+
+void TimerWheel::insert(TimerNode &node) {
+  // Past the top level, wait in the farthest slot and get inserted again
+  // when it comes down
+  const uint64_t horizon = (uint64_t(1) << (SLOT_BITS * NB_LEVELS)) - 1;
+  uint64_t deadline = std::min(node.deadline, mCurrent + horizon);
+  uint64_t delta = deadline - mCurrent;
+
+  unsigned level = 0;
+  while (level + 1 < NB_LEVELS && delta >= (uint64_t(1) << (SLOT_BITS * (level + 1))))
+    ++level;
+  linkBefore(mSlots[level][(deadline >> (SLOT_BITS * level)) & (NB_SLOTS - 1)], node);
+}
+
+void TimerWheel::cascade(unsigned level) {
+  TimerNode &head = mSlots[level][(mCurrent >> (SLOT_BITS * level)) & (NB_SLOTS - 1)];
+  while (head.next != &head) {
+    TimerNode &node = *head.next;
+    unlink(node);
+    insert(node);
+  }
+}
+
+void TimerWheel::advance() {
+  for (uint64_t target = now(); mCurrent < target;) {
+    ++mCurrent;
+
+    // Each level whose lower levels all completed a turn comes down a
+    // level, the highest first so the slots it fills get cascaded too
+    unsigned top = 1;
+    while (top < NB_LEVELS && !(mCurrent & ((uint64_t(1) << (SLOT_BITS * top)) - 1)))
+      ++top;
+    for (unsigned level = top - 1; level > 0; --level)
+      cascade(level);
+
+    // Callbacks may arm or cancel other timers, so take them one at a time
+    TimerNode &head = mSlots[0][mCurrent & (NB_SLOTS - 1)];
+    while (head.next != &head) {
+      TimerNode &node = *head.next;
+      unlink(node);
+      node.callback();
+    }
+  }
+}
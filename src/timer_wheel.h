@@ -0,0 +1,66 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <boost/array.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+// A timer armed on a TimerWheel. Nodes are linked straight into the wheel
+// slots, so arming and cancelling never allocate. The callback is set once
+// by the owner and a node is cancelled when it is destroyed.
+struct TimerNode {
+  TimerNode() : prev(nullptr), next(nullptr), deadline(0) {}
+  ~TimerNode() { cancel(); }
+  TimerNode(const TimerNode &) = delete;
+  TimerNode &operator=(const TimerNode &) = delete;
+
+  bool armed() const { return next != nullptr; }
+  void cancel();
+
+  TimerNode *prev;
+  TimerNode *next;
+  uint64_t deadline;
+  std::function<void()> callback;
+};
+
+// Hierarchical timer wheel with millisecond resolution on the monotonic
+// clock: 4 levels of 256 slots, each level counting in units of a whole
+// turn of the level below. Arming links the node in the slot of its
+// deadline at the coarsest level it needs, cancelling unlinks it, and
+// advancing the wheel moves timers down a level each time the level below
+// completes a turn. The wheel is not thread-safe; each io thread owns one.
+class TimerWheel {
+public:
+  static const unsigned SLOT_BITS = 8;
+  static const unsigned NB_SLOTS = 1 << SLOT_BITS;
+  static const unsigned NB_LEVELS = 4;
+
+  TimerWheel();
+  ~TimerWheel();
+  TimerWheel(const TimerWheel &) = delete;
+  TimerWheel &operator=(const TimerWheel &) = delete;
+
+  // Milliseconds elapsed on the monotonic clock since the wheel was built
+  uint64_t now() const;
+
+  // Runs the node callback once `milliseconds` have elapsed, rearming an
+  // armed node moves it
+  void arm(TimerNode &node, uint64_t milliseconds);
+
+  // Runs the callbacks of every timer due by now
+  void advance();
+
+private:
+  void insert(TimerNode &node);
+  void cascade(unsigned level);
+
+  std::chrono::steady_clock::time_point mStart;
+  // Last millisecond whose timers have run
+  uint64_t mCurrent;
+  // Circular lists, each slot head is a sentinel node
+  boost::array<boost::array<TimerNode, NB_SLOTS>, NB_LEVELS> mSlots;
+};
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,34 @@
+#include "trace.h"
+
+#include <fstream>
+
+static const uint32_t TRACE_VERSION = 2;
+
+template <class T> static void writeValue(std::ofstream &file, T value) {
+  file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+bool SessionTrace::write(const std::string &name,
+                         const boost::optional<unsigned> &seed) const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  std::ofstream file(name, std::ios::out | std::ios::binary | std::ios::trunc);
+
+  file.write("CSGT", 4);
+  writeValue<uint32_t>(file, TRACE_VERSION);
+  writeValue<uint8_t>(file, seed ? 1 : 0);
+  writeValue<uint32_t>(file, seed ? seed.get() : 0);
+  writeValue<uint64_t>(file, mBatches.size());
+
+  for (auto &batch : mBatches) {
+    writeValue(file, batch.connection);
+    writeValue(file, batch.category);
+    writeValue(file, batch.outcome);
+    writeValue<uint16_t>(file, batch.problems.size());
+    for (auto index : batch.problems)
+      writeValue(file, index);
+    writeValue(file, batch.sentAt);
+    writeValue(file, batch.answeredAt);
+  }
+
+  return static_cast<bool>(file);
+}
@@ -0,0 +1,57 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <boost/optional.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+enum BatchOutcome : uint8_t {
+  CORRECT,
+  WRONG,
+  TIMEOUT
+};
+
+// What happened to a single batch of problems. Times are in nanoseconds
+// since the trace was started, answeredAt is 0 if no answer came in time.
+struct BatchRecord {
+  uint32_t connection;
+  uint8_t category;
+  uint8_t outcome;
+  std::vector<uint32_t> problems;
+  uint64_t sentAt;
+  uint64_t answeredAt;
+};
+
+// Every batch of a session, written out as a compact binary trace on exit.
+// All values are little-endian:
+//   header  "CSGT", u32 version, u8 seeded, u32 seed, u64 record count
+//   records u32 connection, u8 category, u8 outcome, u16 batch width,
+//           width x u32 problem indices, u64 send time, u64 answer time
+class SessionTrace {
+public:
+  SessionTrace() : mStart(std::chrono::steady_clock::now()) {}
+
+  uint64_t now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - mStart).count();
+  }
+
+  void record(BatchRecord batch) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mBatches.push_back(std::move(batch));
+  }
+
+  bool write(const std::string &name, const boost::optional<unsigned> &seed) const;
+
+private:
+  std::chrono::steady_clock::time_point mStart;
+  mutable std::mutex mMutex;
+  std::vector<BatchRecord> mBatches;
+};
+
+#endif // TRACE_H
@@ -0,0 +1,38 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <iostream>
+
+// Just enough of a test harness: CHECK reports what failed and carries on,
+// and a test's main returns checkResult() once it has run its cases.
+
+inline int &checkFailures() {
+  static int failures = 0;
+  return failures;
+}
+
+#define CHECK(condition)                                                           \
+  do {                                                                             \
+    if (!(condition)) {                                                            \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" \
+                << std::endl;                                                      \
+      ++checkFailures();                                                           \
+    }                                                                              \
+  } while (false)
+
+#define CHECK_EQUAL(actual, expected)                                                   \
+  do {                                                                                  \
+    if (!((actual) == (expected))) {                                                    \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": " #actual " is " << (actual)       \
+                << ", expected " #expected " (" << (expected) << ")" << std::endl;      \
+      ++checkFailures();                                                                \
+    }                                                                                   \
+  } while (false)
+
+inline int checkResult() {
+  if (checkFailures())
+    std::cerr << checkFailures() << " checks failed" << std::endl;
+  return checkFailures() ? 1 : 0;
+}
+
+#endif // CHECK_H
@@ -0,0 +1,207 @@
+#include "../src/dataset.h"
+#include "../src/page_cache.h"
+#include "check.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+
+// Problems of a category as they would be loaded from a set, every other
+// one the same as the one before
+void fillArena(ProblemType type, size_t count, ProblemArena &arena) {
+  std::mt19937 engine(static_cast<unsigned>(type) + 1);
+  std::vector<int> payload;
+  for (size_t i = 0; i < count; ++i) {
+    if (i % 2 == 0) {
+      payload.resize(1 + engine() % 3000);
+      for (auto &element : payload)
+        element = type == MAZE ? static_cast<int>(engine() & 1)
+                               : static_cast<int>(engine() % 20000) - 10000;
+    }
+    ProblemRecord record{ engine() % 2 == 0, boost::none,
+                          reinterpret_cast<const char *>(payload.data()),
+                          static_cast<unsigned>(payload.size()) };
+    if (type == ARRAY)
+      record.expectedValue = static_cast<int>(i) - 3;
+    arena.addProblem<int>(record);
+  }
+  arena.finishLoading();
+  arena.pack(type);
+  arena.compress();
+}
+
+std::string bytesOf(boost::asio::const_buffer buffer) {
+  return std::string(boost::asio::buffer_cast<const char *>(buffer),
+                     boost::asio::buffer_size(buffer));
+}
+
+// A problem as it goes on the wire in an encoding, whatever the arena
+// keeps it in
+std::string wireOf(const ProblemArena &arena, WireEncoding encoding, size_t index,
+                   PageCache *pages = nullptr) {
+  std::string wire = bytesOf(arena.getWireHeader(encoding, index));
+  if (!arena.isPaged())
+    return wire + bytesOf(arena.getPayload(encoding, index));
+
+  std::vector<boost::asio::const_buffer> buffers;
+  std::vector<uint32_t> pinned;
+  CHECK(arena.appendPayload(encoding, index, buffers, pinned));
+  for (auto &buffer : buffers)
+    wire += bytesOf(buffer);
+  for (uint32_t slot : pinned)
+    pages->unpin(slot);
+  return wire;
+}
+
+// Same problems, answers and bytes on the wire in every encoding; `shard`
+// of `shards` of the original ones
+bool sameProblems(const ProblemArena &original, const ProblemArena &loaded,
+                  unsigned shard = 0, unsigned shards = 1, PageCache *pages = nullptr) {
+  if (loaded.size() != (original.size() + shards - 1 - shard) / shards)
+    return false;
+  for (size_t i = 0; i < loaded.size(); ++i) {
+    size_t from = shard + i * shards;
+    if (loaded.getAnswer(i) != original.getAnswer(from) ||
+        loaded.getLength(i) != original.getLength(from) ||
+        loaded.getExpectedValue(i) != original.getExpectedValue(from))
+      return false;
+    for (int encoding = 0; encoding < NB_WIRE_ENCODINGS; ++encoding) {
+      WireEncoding wire = static_cast<WireEncoding>(encoding);
+      if (wireOf(loaded, wire, i, pages) != wireOf(original, wire, from))
+        return false;
+    }
+  }
+  return true;
+}
+
+bool map(const std::string &name, ProblemType type, ProblemArena &arena, unsigned shard = 0,
+         unsigned shards = 1) {
+  LoadStats stats{ name, 0, 0, 0., 0, 0, 0, 0, 0, 0, 0. };
+  return mapDataset(std::make_shared<MappedFile>(name), type, arena, stats, true, shard, shards);
+}
+
+DatasetHeader headerOf(const std::string &name) {
+  DatasetHeader header;
+  std::ifstream in(name, std::ios::binary);
+  in.read(reinterpret_cast<char *>(&header), sizeof(header));
+  return header;
+}
+
+// Flips the bits of one byte of a copy of a dataset
+std::string damagedCopy(const std::string &name, uint64_t offset, const std::string &copy) {
+  std::ifstream in(name, std::ios::binary);
+  std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  bytes[offset] = static_cast<char>(~bytes[offset]);
+  std::ofstream(copy, std::ios::binary) << bytes;
+  return copy;
+}
+
+void testRoundTrip(const std::string &dir) {
+  const ProblemType types[] = { MAZE, ARRAY };
+  for (ProblemType type : types) {
+    ProblemArena original;
+    fillArena(type, 41, original);
+    std::string name = dir + "/" + getProblemTypeName(type) + ".csgd";
+    CHECK(writeDataset(name, type, original));
+
+    MappedFile file(name);
+    CHECK(isDataset(file));
+    CHECK_EQUAL(getGroupWidth(file), 0u);
+    size_t damaged = 1;
+    CHECK(checkDataset(file, damaged));
+    CHECK_EQUAL(damaged, 0u);
+
+    ProblemArena mapped;
+    CHECK(map(name, type, mapped));
+    CHECK(sameProblems(original, mapped));
+
+    ProblemArena shard;
+    CHECK(map(name, type, shard, 1, 3));
+    CHECK(sameProblems(original, shard, 1, 3));
+
+    // Through a page cache smaller than the dataset
+    std::shared_ptr<PageCache> pages = PageCache::create(2 * PageCache::PAGE_SIZE);
+    ProblemArena paged;
+    LoadStats stats{ name, 0, 0, 0., 0, 0, 0, 0, 0, 0, 0. };
+    CHECK(pageDataset(name, *pages, type, paged, stats, true, 0, 1));
+    CHECK(paged.isPaged());
+    CHECK(sameProblems(original, paged, 0, 1, pages.get()));
+
+    // Served as another category
+    ProblemArena wrong;
+    CHECK(!map(name, type == MAZE ? TREE : MAZE, wrong));
+    std::remove(name.c_str());
+  }
+}
+
+void testDamage(const std::string &dir) {
+  ProblemArena original;
+  fillArena(ARRAY, 20, original);
+  std::string name = dir + "/array.csgd";
+  CHECK(writeDataset(name, ARRAY, original));
+  DatasetHeader header = headerOf(name);
+  size_t damaged = 0;
+
+  // A damaged header or index is refused whole
+  std::string copy = damagedCopy(name, 12, dir + "/header.csgd");
+  ProblemArena arena;
+  CHECK(!map(copy, ARRAY, arena));
+  CHECK(!checkDataset(MappedFile(copy), damaged));
+
+  copy = damagedCopy(name, header.indexOffset + sizeof(DatasetEntry) + 3, dir + "/index.csgd");
+  ProblemArena indexArena;
+  CHECK(!map(copy, ARRAY, indexArena));
+  CHECK(!checkDataset(MappedFile(copy), damaged));
+
+  // A damaged payload is only found by checking them, and problem 5 shares
+  // its payloads with problem 4
+  DatasetEntry entry;
+  {
+    std::ifstream in(name, std::ios::binary);
+    in.seekg(header.indexOffset + 5 * sizeof(DatasetEntry));
+    in.read(reinterpret_cast<char *>(&entry), sizeof(entry));
+  }
+  copy = damagedCopy(name, entry.payloads[PACKED_WIRE].offset, dir + "/payload.csgd");
+  CHECK(checkDataset(MappedFile(copy), damaged));
+  CHECK_EQUAL(damaged, 2u);
+
+  // Truncated, or not a dataset at all
+  {
+    std::ifstream in(name, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::ofstream(dir + "/truncated.csgd", std::ios::binary)
+        << bytes.substr(0, bytes.size() - 1);
+  }
+  ProblemArena truncated;
+  CHECK(!map(dir + "/truncated.csgd", ARRAY, truncated));
+  std::ofstream(dir + "/set.bin", std::ios::binary) << "CSGW";
+  CHECK(!isDataset(MappedFile(dir + "/set.bin")));
+
+  const char *files[] = { "array.csgd", "header.csgd", "index.csgd", "payload.csgd",
+                          "truncated.csgd", "set.bin" };
+  for (const char *file : files)
+    std::remove((dir + "/" + file).c_str());
+}
+
+} // namespace
+
+int main() {
+  char dir[] = "/tmp/dataset_test_XXXXXX";
+  if (!::mkdtemp(dir)) {
+    std::cerr << "Could not make a directory to write datasets to" << std::endl;
+    return 1;
+  }
+  testRoundTrip(dir);
+  testDamage(dir);
+  ::rmdir(dir);
+  return checkResult();
+}
@@ -0,0 +1,104 @@
+#include "../src/histogram.h"
+#include "check.h"
+
+#include <cstdint>
+#include <random>
+
+namespace {
+
+void testEmpty() {
+  LatencyHistogram histogram;
+  CHECK_EQUAL(histogram.count(), 0u);
+  CHECK_EQUAL(histogram.percentile(50), 0u);
+  CHECK_EQUAL(histogram.percentile(100), 0u);
+}
+
+// Values below 64 fall in buckets of their own
+void testSmallValuesAreExact() {
+  LatencyHistogram histogram;
+  for (uint64_t value = 1; value <= 60; ++value)
+    histogram.record(value);
+  CHECK_EQUAL(histogram.count(), 60u);
+  CHECK_EQUAL(histogram.max(), 60u);
+  CHECK_EQUAL(histogram.percentile(50), 30u);
+  CHECK_EQUAL(histogram.percentile(90), 54u);
+  CHECK_EQUAL(histogram.percentile(100), 60u);
+  // The smallest percentile still covers one value
+  CHECK_EQUAL(histogram.percentile(0), 1u);
+}
+
+// Larger values come back as the bound of their bucket, within ~3% above
+// them, and never above the largest value recorded
+void testRelativeError() {
+  std::mt19937_64 engine(7);
+  std::uniform_int_distribution<uint64_t> exponent(6, 50);
+  for (int i = 0; i < 1000; ++i) {
+    uint64_t value = (engine() >> 14) >> (50 - exponent(engine));
+    if (value < 64)
+      continue;
+    LatencyHistogram histogram;
+    histogram.record(value);
+    histogram.record(2 * value + 1);
+    uint64_t p50 = histogram.percentile(50);
+    CHECK(p50 >= value);
+    CHECK(p50 - value <= value / LatencyHistogram::SUB_BUCKETS);
+    CHECK_EQUAL(histogram.percentile(100), 2 * value + 1);
+  }
+}
+
+void testPercentilesOfUniformValues() {
+  LatencyHistogram histogram;
+  for (uint64_t value = 1; value <= 100000; ++value)
+    histogram.record(value * 1000);
+  auto near = [](uint64_t actual, uint64_t expected) {
+    return actual >= expected && actual - expected <= expected / LatencyHistogram::SUB_BUCKETS;
+  };
+  CHECK(near(histogram.percentile(50), 50000000));
+  CHECK(near(histogram.percentile(90), 90000000));
+  CHECK(near(histogram.percentile(99), 99000000));
+  CHECK_EQUAL(histogram.percentile(100), 100000000u);
+  CHECK_EQUAL(histogram.max(), 100000000u);
+}
+
+void testAddAndAssign() {
+  LatencyHistogram low, high, both;
+  for (uint64_t value = 1; value <= 10; ++value) {
+    low.record(value);
+    high.record(value + 10);
+  }
+  both.add(low);
+  both.add(high);
+  CHECK_EQUAL(both.count(), 20u);
+  CHECK_EQUAL(both.max(), 20u);
+  CHECK_EQUAL(both.percentile(50), 10u);
+
+  both.assign(high);
+  CHECK_EQUAL(both.count(), 10u);
+  CHECK_EQUAL(both.percentile(10), 11u);
+}
+
+void testTableBuckets() {
+  CHECK_EQUAL(LatencyTable::sizeBucketOf(0), 0);
+  CHECK_EQUAL(LatencyTable::sizeBucketOf(1023), 0);
+  CHECK_EQUAL(LatencyTable::sizeBucketOf(1024), 1);
+  CHECK_EQUAL(LatencyTable::sizeBucketOf(size_t(1) << 40), LatencyTable::NB_SIZE_BUCKETS - 1);
+
+  LatencyTable table;
+  table.record(MAZE, 2000, 5000);
+  table.recordTimeout(MAZE, 2000);
+  CHECK_EQUAL(table.getHistogram(MAZE, 1).count(), 1u);
+  CHECK_EQUAL(table.getHistogram(MAZE, 0).count(), 0u);
+  CHECK_EQUAL(table.getTimeouts(MAZE, 1), 1u);
+}
+
+} // namespace
+
+int main() {
+  testEmpty();
+  testSmallValuesAreExact();
+  testRelativeError();
+  testPercentilesOfUniformValues();
+  testAddAndAssign();
+  testTableBuckets();
+  return checkResult();
+}
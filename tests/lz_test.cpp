@@ -0,0 +1,123 @@
+#include "../src/lz.h"
+#include "check.h"
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+typedef std::vector<unsigned char> Bytes;
+
+// Compresses after a prefix, as the codec appends, and decodes it back
+bool roundTrips(const Bytes &data, size_t *compressedSize = nullptr) {
+  Bytes out(3, 0xAB);
+  size_t size = lzCompress(data.data(), data.size(), out);
+  if (size != out.size() - 3)
+    return false;
+  if (compressedSize)
+    *compressedSize = size;
+
+  Bytes decoded(data.size() + 1, 0xCD);
+  if (!lzDecompress(out.data() + 3, size, decoded.data(), data.size()))
+    return false;
+  // Nothing written past the end
+  return std::equal(data.begin(), data.end(), decoded.begin()) && decoded.back() == 0xCD;
+}
+
+Bytes randomBytes(size_t size, unsigned seed, int alphabet = 256) {
+  std::mt19937 engine(seed);
+  std::uniform_int_distribution<int> byte(0, alphabet - 1);
+  Bytes data(size);
+  for (auto &b : data)
+    b = static_cast<unsigned char>(byte(engine));
+  return data;
+}
+
+void testRoundTrips() {
+  CHECK(roundTrips(Bytes()));
+  for (size_t size = 1; size < 40; ++size) {
+    CHECK(roundTrips(Bytes(size, 'a')));
+    CHECK(roundTrips(randomBytes(size, static_cast<unsigned>(size))));
+  }
+
+  // Incompressible, then small alphabets that match often, long literal
+  // runs and long matches both needing extra length bytes
+  CHECK(roundTrips(randomBytes(100000, 1)));
+  CHECK(roundTrips(randomBytes(100000, 2, 4)));
+  CHECK(roundTrips(randomBytes(5000, 3, 2)));
+  Bytes mixed = randomBytes(700, 4);
+  mixed.resize(mixed.size() + 70000, 'x');
+  Bytes tail = randomBytes(300, 5);
+  mixed.insert(mixed.end(), tail.begin(), tail.end());
+  CHECK(roundTrips(mixed));
+
+  // Matches as far back as the distance field reaches, and past it
+  Bytes block = randomBytes(1000, 6);
+  Bytes far = block;
+  Bytes gap = randomBytes(64535, 7);
+  far.insert(far.end(), gap.begin(), gap.end());
+  far.insert(far.end(), block.begin(), block.end());
+  CHECK(roundTrips(far));
+  gap = randomBytes(70000, 8);
+  far = block;
+  far.insert(far.end(), gap.begin(), gap.end());
+  far.insert(far.end(), block.begin(), block.end());
+  CHECK(roundTrips(far));
+}
+
+// Problems as the server compresses them, words of small values
+void testWordsShrink() {
+  std::vector<uint32_t> maze(250000);
+  std::mt19937 engine(9);
+  for (auto &cell : maze)
+    cell = engine() % 5 == 0;
+  Bytes data(maze.size() * sizeof(uint32_t));
+  std::memcpy(data.data(), maze.data(), data.size());
+  size_t compressed = 0;
+  CHECK(roundTrips(data, &compressed));
+  CHECK(compressed < data.size() / 3);
+
+  compressed = 0;
+  CHECK(roundTrips(Bytes(1 << 20, 0), &compressed));
+  CHECK(compressed < 5000);
+}
+
+void testRejectsBadInput() {
+  Bytes data = randomBytes(20000, 10, 8);
+  Bytes out;
+  size_t size = lzCompress(data.data(), data.size(), out);
+  Bytes decoded(data.size() + 16);
+
+  // Any other size than the one compressed
+  CHECK(!lzDecompress(out.data(), size, decoded.data(), data.size() - 1));
+  CHECK(!lzDecompress(out.data(), size, decoded.data(), data.size() + 1));
+
+  // Truncated blocks
+  for (size_t cut = 0; cut < size; cut += 1 + cut / 8)
+    CHECK(!lzDecompress(out.data(), cut, decoded.data(), data.size()));
+
+  // A match reaching before the start of the output
+  const unsigned char backwards[] = { 0x10, 'a', 0x05, 0x00, 0x10, 'b' };
+  CHECK(!lzDecompress(backwards, sizeof(backwards), decoded.data(), 7));
+  const unsigned char zeroDistance[] = { 0x10, 'a', 0x00, 0x00, 0x10, 'b' };
+  CHECK(!lzDecompress(zeroDistance, sizeof(zeroDistance), decoded.data(), 6));
+
+  // Garbage never writes past the output, whatever it decodes to
+  for (unsigned seed = 0; seed < 200; ++seed) {
+    Bytes garbage = randomBytes(64, seed);
+    Bytes target(257, 0xEE);
+    lzDecompress(garbage.data(), garbage.size(), target.data(), 256);
+    CHECK(target.back() == 0xEE);
+  }
+}
+
+} // namespace
+
+int main() {
+  testRoundTrips();
+  testWordsShrink();
+  testRejectsBadInput();
+  return checkResult();
+}
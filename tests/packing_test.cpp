@@ -0,0 +1,136 @@
+#include "../src/packing.h"
+#include "check.h"
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+typedef std::vector<unsigned char> Bytes;
+typedef std::vector<unsigned> Words;
+
+unsigned readWord(const Bytes &bytes, size_t offset) {
+  unsigned word;
+  std::memcpy(&word, &bytes[offset], sizeof(word));
+  return word;
+}
+
+Words widen(const std::vector<int> &values) { return Words(values.begin(), values.end()); }
+
+// Packs elements and checks the width they were given and that they come
+// back the same
+void checkElements(const std::vector<int> &values, unsigned expectedBytes) {
+  Words data = widen(values);
+  Bytes packed;
+  packElements(data.data(), data.size(), packed);
+  CHECK_EQUAL(packed.size(), sizeof(unsigned) + 1 + data.size() * expectedBytes);
+  CHECK_EQUAL(readWord(packed, 0), data.size());
+  CHECK_EQUAL(unsigned(packed[4]), expectedBytes);
+
+  Words unpacked(data.size());
+  unpackElements(&packed[5], data.size(), packed[4], unpacked.data());
+  CHECK(unpacked == data);
+}
+
+void testElements() {
+  checkElements({}, 1);
+  checkElements({ 0, 1, -1, 127, -128 }, 1);
+  checkElements({ 0, 128 }, 2);
+  checkElements({ -129, 5 }, 2);
+  checkElements({ 32767, -32768, 7 }, 2);
+  checkElements({ 32768 }, 4);
+  checkElements({ 1, -32769 }, 4);
+  checkElements({ INT32_MAX, INT32_MIN, 0 }, 4);
+  // A wide element anywhere widens them all
+  std::vector<int> late(1000, 3);
+  late.back() = 100000;
+  checkElements(late, 4);
+}
+
+void testStrings() {
+  // Characters are widened from a signed char
+  std::vector<int> characters{ 'a', 'Z', '0', ' ', -1, -128, 127 };
+  Words data = widen(characters);
+  Bytes packed;
+  packString(data.data(), data.size(), packed);
+  CHECK_EQUAL(packed.size(), sizeof(unsigned) + data.size());
+  CHECK_EQUAL(readWord(packed, 0), data.size());
+  CHECK_EQUAL(packed[4], 'a');
+
+  Words unpacked(data.size());
+  unpackString(&packed[4], data.size(), unpacked.data());
+  CHECK(unpacked == data);
+}
+
+void checkMazeRoundTrip(unsigned side, unsigned seed) {
+  std::mt19937 engine(seed);
+  Words maze(static_cast<size_t>(side) * side);
+  for (auto &cell : maze)
+    cell = engine() & 1;
+  Bytes packed;
+  packMaze(maze.data(), maze.size(), packed);
+  CHECK_EQUAL(readWord(packed, 0), side);
+  CHECK_EQUAL(readWord(packed, 4), side);
+  CHECK_EQUAL(packed.size(), 8 + side * packedRowBytes(side));
+
+  Words unpacked(maze.size());
+  unpackMaze(&packed[8], side, side, unpacked.data());
+  CHECK(unpacked == maze);
+}
+
+void testMazes() {
+  CHECK_EQUAL(packedRowBytes(0), 0u);
+  CHECK_EQUAL(packedRowBytes(1), 1u);
+  CHECK_EQUAL(packedRowBytes(8), 1u);
+  CHECK_EQUAL(packedRowBytes(9), 2u);
+
+  const unsigned sides[] = { 1, 2, 7, 8, 9, 31, 100, 1001 };
+  for (unsigned side : sides)
+    checkMazeRoundTrip(side, side);
+
+  // Cell j of a row in bit j % 8 of byte j / 8, each row starting a byte
+  Words maze{ 1, 0, 0, 0, 0, 0, 0, 0, 1,
+              0, 0, 0, 0, 0, 0, 0, 0, 0,
+              0, 0, 0, 0, 0, 0, 0, 0, 0,
+              0, 0, 0, 0, 0, 0, 0, 0, 0,
+              0, 0, 0, 0, 0, 0, 0, 0, 0,
+              0, 0, 0, 0, 0, 0, 0, 0, 0,
+              0, 0, 0, 0, 0, 0, 0, 0, 0,
+              0, 0, 0, 0, 0, 0, 0, 0, 0,
+              0, 1, 0, 0, 0, 0, 0, 0, 0 };
+  Bytes packed;
+  packMaze(maze.data(), maze.size(), packed);
+  CHECK_EQUAL(packed.size(), 8u + 9 * 2);
+  CHECK_EQUAL(unsigned(packed[8]), 0x01u);
+  CHECK_EQUAL(unsigned(packed[9]), 0x01u);
+  CHECK_EQUAL(unsigned(packed[8 + 8 * 2]), 0x02u);
+
+  // Mazes that are not squares of bits go as the other arrays after a
+  // width of 0
+  Words notSquare{ 1, 0, 1 };
+  Words notBinary{ 1, 0, 2, 1 };
+  for (const Words *data : { &notSquare, &notBinary }) {
+    packed.clear();
+    packMaze(data->data(), data->size(), packed);
+    CHECK_EQUAL(readWord(packed, 0), 0u);
+    CHECK_EQUAL(readWord(packed, 4), data->size());
+    Words unpacked(data->size());
+    unpackElements(&packed[9], data->size(), packed[8], unpacked.data());
+    CHECK(unpacked == *data);
+  }
+  packed.clear();
+  packMaze(nullptr, 0, packed);
+  CHECK_EQUAL(readWord(packed, 0), 0u);
+  CHECK_EQUAL(readWord(packed, 4), 0u);
+}
+
+} // namespace
+
+int main() {
+  testElements();
+  testStrings();
+  testMazes();
+  return checkResult();
+}
@@ -0,0 +1,131 @@
+#include "../src/problem_store.h"
+#include "check.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::unique_ptr<ProblemSet> makeSet() { return std::unique_ptr<ProblemSet>(new ProblemSet); }
+
+void testNothingPublished() {
+  ProblemStore store;
+  CHECK(store.pin() == nullptr);
+  store.unpin(nullptr);
+  CHECK_EQUAL(store.reclaim(), 0u);
+}
+
+// A retired set stays until its last pin goes, from every thread
+void testRetiredSetsWaitForTheirPins() {
+  ProblemStore store;
+  store.publish(makeSet());
+  const ProblemSet *first = store.pin();
+  CHECK(first != nullptr);
+  const ProblemSet *again = store.pin();
+  CHECK(again == first);
+
+  store.publish(makeSet());
+  const ProblemSet *second = store.pin();
+  CHECK(second != first);
+  CHECK(second->epoch > first->epoch);
+
+  CHECK_EQUAL(store.reclaim(), 1u);
+  store.unpin(first);
+  CHECK_EQUAL(store.reclaim(), 1u);
+  store.unpin(again);
+  CHECK_EQUAL(store.reclaim(), 0u);
+  store.unpin(second);
+
+  // A pin held by another thread holds the set back all the same
+  std::mutex mutex;
+  std::condition_variable changed;
+  int step = 0;
+  std::thread reader([&]() {
+    const ProblemSet *set = store.pin();
+    std::unique_lock<std::mutex> lock(mutex);
+    step = 1;
+    changed.notify_all();
+    changed.wait(lock, [&]() { return step == 2; });
+    store.unpin(set);
+    step = 3;
+    changed.notify_all();
+  });
+
+  std::unique_lock<std::mutex> lock(mutex);
+  changed.wait(lock, [&]() { return step == 1; });
+  store.publish(makeSet());
+  CHECK_EQUAL(store.reclaim(), 1u);
+  step = 2;
+  changed.notify_all();
+  changed.wait(lock, [&]() { return step == 3; });
+  lock.unlock();
+  reader.join();
+  CHECK_EQUAL(store.reclaim(), 0u);
+}
+
+// Readers pinning and unpinning while sets are published and reclaimed
+// only ever see a set that is current or not yet reclaimed, whose epoch
+// never goes back
+void testConcurrentReaders() {
+  ProblemStore store;
+  store.publish(makeSet());
+
+  std::atomic<bool> done(false);
+  std::atomic<int> failures(0);
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 3; ++i) {
+    readers.emplace_back([&]() {
+      uint64_t last = 0;
+      while (!done.load()) {
+        const ProblemSet *set = store.pin();
+        if (!set || set->epoch < last)
+          ++failures;
+        last = set ? set->epoch : last;
+        // Hold a second pin across a yield now and then
+        const ProblemSet *held = store.pin();
+        std::this_thread::yield();
+        if (held && held->epoch < last)
+          ++failures;
+        store.unpin(held);
+        store.unpin(set);
+      }
+    });
+  }
+
+  for (int i = 0; i < 2000; ++i) {
+    store.publish(makeSet());
+    store.reclaim();
+  }
+  done = true;
+  for (auto &reader : readers)
+    reader.join();
+  CHECK_EQUAL(failures.load(), 0);
+  CHECK_EQUAL(store.reclaim(), 0u);
+}
+
+// A store built after another is gone does not inherit its thread records
+void testStoresInTurn() {
+  for (int i = 0; i < 3; ++i) {
+    ProblemStore store;
+    store.publish(makeSet());
+    const ProblemSet *set = store.pin();
+    store.publish(makeSet());
+    CHECK_EQUAL(store.reclaim(), 1u);
+    store.unpin(set);
+    CHECK_EQUAL(store.reclaim(), 0u);
+  }
+}
+
+} // namespace
+
+int main() {
+  testNothingPublished();
+  testRetiredSetsWaitForTheirPins();
+  testConcurrentReaders();
+  testStoresInTurn();
+  return checkResult();
+}
@@ -0,0 +1,136 @@
+#include "../src/sampler.h"
+#include "check.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace {
+
+// Draws from a table and checks every index comes up as often as its
+// weight says, within a few standard deviations
+void checkFrequencies(const std::vector<double> &weights) {
+  AliasTable table(weights);
+  CHECK(!table.empty());
+
+  const size_t draws = 200000;
+  std::mt19937 engine(1);
+  std::vector<size_t> counts(weights.size(), 0);
+  for (size_t i = 0; i < draws; ++i)
+    ++counts[table.sample(engine)];
+
+  double total = 0.;
+  for (double weight : weights)
+    total += weight;
+  for (size_t i = 0; i < weights.size(); ++i) {
+    double p = weights[i] / total;
+    double expected = p * draws;
+    double tolerance = 5. * std::sqrt(draws * p * (1. - p)) + 1.;
+    CHECK(std::fabs(counts[i] - expected) <= tolerance);
+    if (weights[i] == 0.)
+      CHECK_EQUAL(counts[i], 0u);
+  }
+}
+
+void testAliasTable() {
+  checkFrequencies({ 1. });
+  checkFrequencies({ 1., 1., 1., 1. });
+  checkFrequencies({ 1., 2., 3., 0., 4. });
+  checkFrequencies({ 1000., 1., 0., 0.5 });
+  checkFrequencies({ 0., 0., 7. });
+
+  CHECK(AliasTable().empty());
+  CHECK(AliasTable(std::vector<double>()).empty());
+  CHECK(AliasTable({ 0., 0. }).empty());
+}
+
+void testParsing() {
+  SamplerConfig config;
+  CHECK(parseCategoryWeights("maze=2,tree=0", config));
+  CHECK_EQUAL(config.categoryWeights[MAZE], 2.);
+  CHECK_EQUAL(config.categoryWeights[TREE], 0.);
+  CHECK_EQUAL(config.categoryWeights[SUDOKU], 1.);
+  CHECK(!parseCategoryWeights("maze", config));
+  CHECK(!parseCategoryWeights("labyrinth=1", config));
+  CHECK(!parseCategoryWeights("maze=-1", config));
+  CHECK(!parseCategoryWeights("maze=2x", config));
+
+  CHECK(parseSizeWeights("sudoku=4K:1,16K:3", config));
+  CHECK_EQUAL(config.sizeWeights[SUDOKU].size(), size_t(ProblemSampler::NB_SIZE_CLASSES));
+  CHECK_EQUAL(config.sizeWeights[SUDOKU][2], 1.);
+  CHECK_EQUAL(config.sizeWeights[SUDOKU][3], 3.);
+  CHECK_EQUAL(config.sizeWeights[SUDOKU][0], 0.);
+  CHECK(parseSizeWeights("maze=largest", config));
+  CHECK(config.largestOnly[MAZE]);
+  CHECK(!parseSizeWeights("maze=3K", config));
+  CHECK(!parseSizeWeights("4K:1", config));
+}
+
+void testSizeClasses() {
+  CHECK_EQUAL(ProblemSampler::sizeClassOf(0), 0);
+  CHECK_EQUAL(ProblemSampler::sizeClassOf(255), 0);
+  CHECK_EQUAL(ProblemSampler::sizeClassOf(256), 1);
+  CHECK_EQUAL(ProblemSampler::sizeClassOf(1023), 1);
+  CHECK_EQUAL(ProblemSampler::sizeClassOf(1024), 2);
+  CHECK_EQUAL(ProblemSampler::sizeClassOf(size_t(1) << 30), ProblemSampler::NB_SIZE_CLASSES - 1);
+}
+
+// Adds problems of `elements` elements each to an arena
+void addProblems(ProblemArena &arena, size_t count, unsigned elements) {
+  std::vector<int> payload(elements);
+  for (size_t i = 0; i < count; ++i) {
+    // Distinct payloads, so none is shared
+    payload[0] = static_cast<int>(arena.size());
+    ProblemRecord record{ false, boost::none, reinterpret_cast<const char *>(payload.data()),
+                          elements };
+    arena.addProblem<int>(record);
+  }
+}
+
+void testProblemSampler() {
+  ProblemContainer problems;
+  // Mazes 0-9 are small and 10-11 large, trees are all small
+  addProblems(problems.getArena(MAZE), 10, 100);
+  addProblems(problems.getArena(MAZE), 2, 5000);
+  addProblems(problems.getArena(TREE), 5, 10);
+
+  std::mt19937 engine(3);
+  ProblemSampler sampler;
+  SamplerConfig config;
+  CHECK(sampler.build(problems, config));
+  size_t trees = 0, largeMazes = 0;
+  for (int i = 0; i < 10000; ++i) {
+    ProblemType type = sampler.sampleCategory(engine);
+    CHECK(type == MAZE || type == TREE);
+    trees += type == TREE;
+    largeMazes += type == MAZE && sampler.sampleProblem(MAZE, engine) >= 10;
+  }
+  // Categories weigh the same, and every maze is as likely by default
+  CHECK(trees > 4500 && trees < 5500);
+  CHECK(largeMazes > 500 && largeMazes < 1200);
+
+  // Only the largest mazes, and no trees
+  CHECK(parseSizeWeights("maze=largest", config));
+  CHECK(parseCategoryWeights("tree=0", config));
+  ProblemSampler largest;
+  CHECK(largest.build(problems, config));
+  for (int i = 0; i < 1000; ++i) {
+    CHECK_EQUAL(largest.sampleCategory(engine), MAZE);
+    CHECK(largest.sampleProblem(MAZE, engine) >= 10);
+  }
+
+  // Nothing left to send
+  CHECK(parseCategoryWeights("maze=0", config));
+  ProblemSampler nothing;
+  CHECK(!nothing.build(problems, config));
+}
+
+} // namespace
+
+int main() {
+  testAliasTable();
+  testParsing();
+  testSizeClasses();
+  testProblemSampler();
+  return checkResult();
+}
@@ -0,0 +1,124 @@
+#include "../src/timer_wheel.h"
+#include "check.h"
+
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Advances the wheel until `done` or a second has gone by
+template <class Predicate>
+void advanceUntil(TimerWheel &wheel, Predicate done) {
+  auto giveUp = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+  while (!done() && std::chrono::steady_clock::now() < giveUp) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    wheel.advance();
+  }
+}
+
+// Timers fire once, never before their delay, whichever level of the wheel
+// they were armed on
+void testFiresAfterDelay() {
+  TimerWheel wheel;
+  const uint64_t delays[] = { 0, 3, 40, 255, 256, 300 };
+  std::vector<std::unique_ptr<TimerNode>> nodes;
+  std::vector<uint64_t> armedAt, firedAt;
+  std::vector<int> fired;
+  for (uint64_t delay : delays) {
+    size_t i = nodes.size();
+    nodes.emplace_back(new TimerNode);
+    armedAt.push_back(wheel.now());
+    firedAt.push_back(0);
+    fired.push_back(0);
+    nodes[i]->callback = [&, i]() {
+      ++fired[i];
+      firedAt[i] = wheel.now();
+    };
+    wheel.arm(*nodes[i], delay);
+    CHECK(nodes[i]->armed());
+  }
+
+  advanceUntil(wheel, [&]() { return !nodes.back()->armed(); });
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    CHECK_EQUAL(fired[i], 1);
+    CHECK(!nodes[i]->armed());
+    CHECK(firedAt[i] >= armedAt[i] + delays[i]);
+  }
+}
+
+void testCancelAndRearm() {
+  TimerWheel wheel;
+  int cancelledFired = 0, rearmedFired = 0;
+  TimerNode cancelled, rearmed;
+  cancelled.callback = [&]() { ++cancelledFired; };
+  rearmed.callback = [&]() { ++rearmedFired; };
+
+  wheel.arm(cancelled, 5);
+  cancelled.cancel();
+  CHECK(!cancelled.armed());
+  // Cancelling twice is harmless
+  cancelled.cancel();
+
+  // Rearming moves the timer rather than adding a second one
+  wheel.arm(rearmed, 500);
+  uint64_t rearmedAt = wheel.now();
+  wheel.arm(rearmed, 10);
+  advanceUntil(wheel, [&]() { return rearmedFired > 0; });
+  CHECK_EQUAL(rearmedFired, 1);
+  CHECK(wheel.now() >= rearmedAt + 10);
+  CHECK(wheel.now() < rearmedAt + 500);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  wheel.advance();
+  CHECK_EQUAL(cancelledFired, 0);
+  CHECK_EQUAL(rearmedFired, 1);
+}
+
+// A callback may arm its own node again, and cancel one due in the same
+// millisecond
+void testCallbacksArmAndCancel() {
+  TimerWheel wheel;
+  int ticks = 0, victimFired = 0;
+  TimerNode ticker, victim;
+  ticker.callback = [&]() {
+    if (++ticks < 3)
+      wheel.arm(ticker, 2);
+    victim.cancel();
+  };
+  victim.callback = [&]() { ++victimFired; };
+  wheel.arm(ticker, 1);
+  wheel.arm(victim, 1);
+  advanceUntil(wheel, [&]() { return ticks == 3; });
+  CHECK_EQUAL(ticks, 3);
+  CHECK(!ticker.armed());
+
+  // The ticker fired first as it was armed first
+  CHECK_EQUAL(victimFired, 0);
+}
+
+// Nodes outliving their wheel, or dying while armed, leave nothing dangling
+void testLifetimes() {
+  TimerNode survivor;
+  {
+    TimerWheel wheel;
+    wheel.arm(survivor, 1000);
+    {
+      TimerNode shortLived;
+      wheel.arm(shortLived, 1000);
+    }
+    CHECK(survivor.armed());
+  }
+  CHECK(!survivor.armed());
+}
+
+} // namespace
+
+int main() {
+  testFiresAfterDelay();
+  testCancelAndRearm();
+  testCallbacksArmAndCancel();
+  testLifetimes();
+  return checkResult();
+}